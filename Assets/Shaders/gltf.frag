@@ -0,0 +1,29 @@
+#version 460
+// BINDLESS_MATERIALS is a global define set from MaterialSystem::IsBindless(), so every stage,
+// GLSL or SPIR-V, takes the same path as the material data.
+#if BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#endif
+
+// Forward shading of glTF meshes, the reference for the visibility buffer path.
+layout(location = 0) out vec4 FragColor;
+
+layout(location = 0) in PerVertexData
+{
+  vec3 normalWS;
+  vec2 uv;
+  vec3 positionWS;
+} frag_in;
+
+layout(location = 3) flat in uint frag_material;
+
+#include "uniforms.glsl"
+#include "material.glsl"
+
+void main()
+{
+  vec3 N = normalize(frag_in.normalWS);
+  vec3 V = normalize(transform_ub.CameraPosition - frag_in.positionWS);
+  vec3 color = ShadeMaterial(frag_material, frag_in.uv, dFdx(frag_in.uv), dFdy(frag_in.uv), N, V, frag_in.positionWS, gl_FragCoord.xy);
+  FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,20 @@
+// glTF meshlets, see Mesh in mesh.h; SSBO bindings 3 to 6.
+struct Vertex
+{
+  vec4 positionU;
+  vec4 normalV;
+};
+
+struct Meshlet
+{
+  uint vertexOffset;
+  uint vertexCount;
+  uint triangleOffset;
+  uint triangleCount;
+  uint material;
+};
+
+layout(std430, binding = 3) readonly buffer Vertices { Vertex vertices[]; };
+layout(std430, binding = 4) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, binding = 5) readonly buffer MeshletVertices { uint meshletVertices[]; };
+layout(std430, binding = 6) readonly buffer MeshletTriangles { uint meshletTriangles[]; };
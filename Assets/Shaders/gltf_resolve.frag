@@ -0,0 +1,73 @@
+#version 460
+// BINDLESS_MATERIALS is a global define set from MaterialSystem::IsBindless(), so every stage,
+// GLSL or SPIR-V, takes the same path as the material data.
+#if BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#endif
+
+// Visibility buffer resolve: fetches the triangle that covers the pixel, reconstructs its
+// perspective-correct barycentrics and shades exactly once per pixel.
+layout(location = 0) out vec4 FragColor;
+
+#include "uniforms.glsl"
+#include "gltf_mesh.glsl"
+#include "material.glsl"
+
+layout(binding = 3) uniform usampler2D Visibility;
+
+// Barycentrics of an NDC position inside a clip space triangle, corrected for perspective.
+vec3 Barycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc)
+{
+  vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+  vec2 p0 = c0.xy * invW.x;
+  vec2 p1 = c1.xy * invW.y;
+  vec2 p2 = c2.xy * invW.z;
+
+  float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+  vec3 screen;
+  screen.x = ((p1.x - ndc.x) * (p2.y - ndc.y) - (p2.x - ndc.x) * (p1.y - ndc.y)) / area;
+  screen.y = ((p2.x - ndc.x) * (p0.y - ndc.y) - (p0.x - ndc.x) * (p2.y - ndc.y)) / area;
+  screen.z = 1.0 - screen.x - screen.y;
+
+  vec3 perspective = screen * invW;
+  return perspective / (perspective.x + perspective.y + perspective.z);
+}
+
+void main()
+{
+  uint id = texelFetch(Visibility, ivec2(gl_FragCoord.xy), 0).x;
+  if (id == 0)
+    discard;
+  id -= 1;
+
+  Meshlet meshlet = meshlets[id >> MESHLET_TRIANGLE_BITS];
+  uint packed = meshletTriangles[meshlet.triangleOffset + (id & ((1u << MESHLET_TRIANGLE_BITS) - 1))];
+  Vertex v0 = vertices[meshletVertices[meshlet.vertexOffset + (packed & 0xFF)]];
+  Vertex v1 = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)]];
+  Vertex v2 = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)]];
+
+  mat4 MVP = transform_ub.ViewProjectionMatrix * transform_ub.ModelMatrix;
+  vec4 c0 = MVP * vec4(v0.positionU.xyz, 1.0);
+  vec4 c1 = MVP * vec4(v1.positionU.xyz, 1.0);
+  vec4 c2 = MVP * vec4(v2.positionU.xyz, 1.0);
+
+  vec2 size = vec2(textureSize(Visibility, 0));
+  vec2 ndc = gl_FragCoord.xy / size * 2.0 - 1.0;
+  vec3 b = Barycentrics(c0, c1, c2, ndc);
+  // Neighbouring pixels give the UV gradients the hardware would take from the quad.
+  vec3 bx = Barycentrics(c0, c1, c2, ndc + vec2(2.0 / size.x, 0.0));
+  vec3 by = Barycentrics(c0, c1, c2, ndc + vec2(0.0, 2.0 / size.y));
+
+  mat3x2 uvs = mat3x2(vec2(v0.positionU.w, v0.normalV.w), vec2(v1.positionU.w, v1.normalV.w), vec2(v2.positionU.w, v2.normalV.w));
+  vec2 uv = uvs * b;
+  vec3 normalWS = mat3(transform_ub.ModelMatrix) * (mat3(v0.normalV.xyz, v1.normalV.xyz, v2.normalV.xyz) * b);
+  vec4 clip = mat4(c0, c1, c2, vec4(0.0)) * vec4(b, 0.0);
+
+  vec3 positionWS = (transform_ub.ModelMatrix * vec4(mat3(v0.positionU.xyz, v1.positionU.xyz, v2.positionU.xyz) * b, 1.0)).xyz;
+
+  vec3 N = normalize(normalWS);
+  vec3 V = normalize(transform_ub.CameraPosition - positionWS);
+  vec3 color = ShadeMaterial(meshlet.material, uv, uvs * bx - uv, uvs * by - uv, N, V, positionWS, gl_FragCoord.xy);
+  FragColor = vec4(color, 1.0);
+  gl_FragDepth = clip.z / clip.w;
+}
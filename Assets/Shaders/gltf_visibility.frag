@@ -0,0 +1,9 @@
+#version 460
+
+// Only the triangle ID, attributes are reconstructed once per pixel by gltf_resolve.frag.
+layout(location = 0) out uint Visibility;
+
+void main()
+{
+  Visibility = uint(gl_PrimitiveID);
+}
@@ -7,16 +7,18 @@ layout(location = 0) in PerVertexData
   vec4 color;
   vec3 viewDirWS;  
   vec3 tangentWS;
+  vec3 positionWS;
 } frag_in;  
 
-layout(std140, binding = 1) uniform Light
-{
-	vec3 direction;
-	float padding0;
-	vec3 color;
-	float padding1;
-} Sun;
- 
+// Distance to the strand center and strand half width in pixels, and the fraction of the drawn
+// width the strand really covers when it was widened to a minimum width.
+layout(location = 4) noperspective in vec3 frag_coverage;
+
+#include "lighting.glsl"
+#include "hair_shadow.glsl"
+
+layout(binding = 2) uniform sampler2D HairOpacityMap;
+
 float StrandSpecular(vec3 T, vec3 V, vec3 L, float exponent)
 {
 	vec3 H = normalize(V + L);
@@ -27,8 +29,55 @@ float StrandSpecular(vec3 T, vec3 V, vec3 L, float exponent)
 	return dirAtten * pow(sinToH, exponent);
 }
 
+// Light transmittance through the groom, from the deep opacity maps.
+float HairShadow(vec3 positionWS)
+{
+	vec4 positionLS = DOM.LightVP * vec4(positionWS, 1.0);
+	vec3 uvz = positionLS.xyz / positionLS.w;
+	vec2 uv = uvz.xy * 0.5 + 0.5;
+
+	float dz = max(uvz.z - texture(HairDepthMap, uv).r, 0.0);
+	vec4 layers = texture(HairOpacityMap, uv);
+	vec4 ends = DOM.LayerDepths;
+
+	// Interpolate linearly between the layer ends, the last layer extends to the back of the groom.
+	float opacity;
+	if (dz < ends.x)
+		opacity = mix(0.0, layers.x, dz / ends.x);
+	else if (dz < ends.y)
+		opacity = mix(layers.x, layers.y, (dz - ends.x) / (ends.y - ends.x));
+	else if (dz < ends.z)
+		opacity = mix(layers.y, layers.z, (dz - ends.y) / (ends.z - ends.y));
+	else if (dz < ends.w)
+		opacity = mix(layers.z, layers.w, (dz - ends.z) / (ends.w - ends.z));
+	else
+		opacity = layers.w;
+
+	return exp(-DOM.ShadowDensity * opacity);
+}
+
+// Fraction of the pixel's width covered by a strand, a box filter across the strand.
+float Coverage(float distance, float halfWidth)
+{
+	return clamp(min(distance + halfWidth, 0.5) - max(distance - halfWidth, -0.5), 0.0, 1.0);
+}
+
 void main()
 {
-	FragColor.rgb = frag_in.color.rgb * StrandSpecular(normalize(frag_in.tangentWS), normalize(frag_in.viewDirWS), normalize(Sun.direction), 16) + vec3(0.1);
-	FragColor.a = frag_in.color.a + 0.3;
+	float shadow = HairShadow(frag_in.positionWS);
+	vec3 T = normalize(frag_in.tangentWS);
+	vec3 V = normalize(frag_in.viewDirWS);
+	// Ambient light uses the normal facing the viewer across the strand.
+	vec3 N = normalize(V - T * dot(T, V));
+	vec3 ambient = frag_in.color.rgb * SHIrradiance(N) + PrefilteredRadiance(reflect(-V, N), 0.6) * 0.04;
+	FragColor.rgb = frag_in.color.rgb * StrandSpecular(T, V, normalize(Sun.direction), 16) * shadow + ambient;
+
+	uvec2 cluster = ClusterLights(gl_FragCoord.xy, frag_in.positionWS);
+	for (uint i = 0; i < cluster.y; ++i)
+	{
+		vec3 L;
+		vec3 radiance = PunctualRadiance(lights[lightIndices[cluster.x + i]], frag_in.positionWS, L);
+		FragColor.rgb += frag_in.color.rgb * StrandSpecular(T, V, L, 16) * radiance;
+	}
+	FragColor.a = (frag_in.color.a + 0.3) * Coverage(frag_coverage.x, frag_coverage.y) * frag_coverage.z;
 }
\ No newline at end of file
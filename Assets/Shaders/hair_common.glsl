@@ -0,0 +1,33 @@
+// Shared by the hair mesh shaders: strand points and meshlets, and the interface to hair.frag.
+#include "uniforms.glsl"
+
+layout (std430, binding = 0) buffer _vertices
+{
+  float positions[];
+} vb;
+
+layout (location = 0) uniform vec4 color;
+
+struct s_meshlet
+{
+  uint vertex_offset;
+  uint vertex_count;
+  uint index_offset;
+  uint index_count;
+};
+
+layout (std430, binding = 1) buffer _meshlets
+{
+  s_meshlet meshlets[];
+} mbuf;
+
+layout (location = 0) out PerVertexData
+{
+  vec4 color;
+  vec3 viewDirWS;
+  vec3 tangentWS;
+  vec3 positionWS;
+} v_out[];
+
+// Distance to the strand center and half width in pixels, covered fraction of the drawn width.
+layout (location = 4) noperspective out vec3 v_coverage[];
@@ -0,0 +1,6 @@
+#version 460
+
+// Depth-only pass of the hair deep opacity maps: finds the first strand (z0) seen from the light.
+void main()
+{
+}
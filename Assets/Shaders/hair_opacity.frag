@@ -0,0 +1,22 @@
+#version 460
+
+layout(location = 0) out vec4 Opacity;
+ 
+layout(location = 0) in PerVertexData
+{
+  vec4 color;
+  vec3 viewDirWS;  
+  vec3 tangentWS;
+  vec3 positionWS;
+} frag_in;  
+
+#include "hair_shadow.glsl"
+
+void main()
+{
+	float z0 = texelFetch(HairDepthMap, ivec2(gl_FragCoord.xy), 0).r;
+	float dz = gl_FragCoord.z - z0;
+
+	// Each layer holds the opacity accumulated from z0 to its end, so a strand adds to its own layer and every one behind it.
+	Opacity = DOM.StrandOpacity * vec4(lessThanEqual(vec4(dz), DOM.LayerDepths));
+}
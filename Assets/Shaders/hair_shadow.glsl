@@ -0,0 +1,12 @@
+// Deep opacity map parameters and the nearest hair depth, DeepOpacityMap in shadow.h.
+layout(std140, binding = 2) uniform Shadow
+{
+	mat4 LightVP;
+	vec4 LayerDepths;
+	float StrandOpacity;
+	float ShadowDensity;
+	float padding0;
+	float padding1;
+} DOM;
+
+layout(binding = 1) uniform sampler2D HairDepthMap;
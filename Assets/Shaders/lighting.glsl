@@ -0,0 +1,91 @@
+// Sun, clustered punctual lights and image based lighting, shared by the surface shaders.
+
+layout(std140, binding = 1) uniform Light
+{
+	vec3 direction;
+	float padding0;
+	vec3 color;
+	float padding1;
+} Sun;
+
+// Clustered punctual lights, binned by light_cull.comp.
+struct PunctualLight
+{
+	vec3 position;
+	float range;
+	vec3 color;
+	uint type;
+	vec3 direction;
+	float cosOuter;
+	float cosInner;
+	float padding0;
+	float padding1;
+	float padding2;
+};
+
+layout(std140, binding = 3) uniform Clusters
+{
+	mat4 View;
+	mat4 InverseProjection;
+	uvec4 Grid;
+	vec4 Depth;
+	vec4 Params;
+} Cluster;
+
+layout(std430, binding = 7) readonly buffer Lights { PunctualLight lights[]; };
+layout(std430, binding = 8) readonly buffer ClusterRanges { uvec2 clusterRanges[]; };
+layout(std430, binding = 9) readonly buffer LightIndices { uint lightIndices[]; };
+
+// Image based lighting, precomputed by EnvironmentLighting in ibl.h.
+layout(std140, binding = 4) uniform Irradiance { vec4 SH[9]; };
+layout(binding = 5) uniform samplerCube Prefiltered;
+
+// Cosine convolved irradiance divided by pi, so diffuse = albedo * SHIrradiance(N).
+vec3 SHIrradiance(vec3 n)
+{
+  return max(SH[0].rgb * 0.282095
+    + (SH[1].rgb * n.y + SH[2].rgb * n.z + SH[3].rgb * n.x) * 0.488603
+    + (SH[4].rgb * n.x * n.y + SH[5].rgb * n.y * n.z + SH[7].rgb * n.x * n.z) * 1.092548
+    + SH[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+    + SH[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y), 0.0);
+}
+
+// Prefiltered radiance around R, the mip levels span roughness 0 to 1.
+vec3 PrefilteredRadiance(vec3 R, float roughness)
+{
+  return textureLod(Prefiltered, R, roughness * float(textureQueryLevels(Prefiltered) - 1)).rgb;
+}
+
+// Analytic fit of the split sum environment BRDF (Karis, "Mobile PBR").
+vec3 EnvBRDFApprox(vec3 F0, float roughness, float NoV)
+{
+  const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+  const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+  vec4 r = roughness * c0 + c1;
+  float a004 = min(r.x * r.x, exp2(-9.28 * NoV)) * r.x + r.y;
+  vec2 AB = vec2(-1.04, 1.04) * a004 + r.zw;
+  return F0 * AB.x + AB.y;
+}
+
+// Offset and count of the lights in the cluster containing the fragment.
+uvec2 ClusterLights(vec2 fragCoord, vec3 positionWS)
+{
+	float depth = -(Cluster.View * vec4(positionWS, 1.0)).z;
+	uvec2 tile = min(uvec2(fragCoord / Cluster.Params.xy), Cluster.Grid.xy - 1);
+	uint slice = uint(clamp(log(max(depth, 1e-4)) * Cluster.Depth.z + Cluster.Depth.w, 0.0, float(Cluster.Grid.z - 1)));
+	return clusterRanges[tile.x + Cluster.Grid.x * (tile.y + Cluster.Grid.y * slice)];
+}
+
+// Unshadowed radiance of a light at a point and the direction towards it.
+vec3 PunctualRadiance(PunctualLight light, vec3 positionWS, out vec3 L)
+{
+	vec3 toLight = light.position - positionWS;
+	float distance2 = dot(toLight, toLight);
+	L = toLight * inversesqrt(max(distance2, 1e-8));
+	float ratio = distance2 / (light.range * light.range);
+	float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+	float attenuation = window * window / (distance2 + 1.0);
+	if (light.type == 1)
+		attenuation *= smoothstep(light.cosOuter, light.cosInner, dot(-L, light.direction));
+	return light.color * attenuation;
+}
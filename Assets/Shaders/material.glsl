@@ -0,0 +1,65 @@
+// Needs the including shader to enable GL_ARB_bindless_texture when BINDLESS_MATERIALS is 1,
+// which has to happen before any declaration.
+#include "lighting.glsl"
+
+// Materials, see MaterialSystem in material.h. A texture slot holds a bindless handle, or the
+// texture array layer + 1 in x without bindless support; zero means no texture.
+struct Material
+{
+  vec4 baseColorFactor;
+  vec3 emissiveFactor;
+  float occlusionStrength;
+  float metallicFactor;
+  float roughnessFactor;
+  float padding0;
+  float padding1;
+  uvec2 textures[4];  // base color, metallic-roughness, occlusion, emissive
+};
+
+layout(std430, binding = 12) readonly buffer Materials { Material materials[]; };
+
+#if !BINDLESS_MATERIALS
+layout(binding = 7) uniform sampler2DArray ColorTextures;
+layout(binding = 8) uniform sampler2DArray DataTextures;
+#endif
+
+// A material texture with explicit gradients, `fallback` for an empty slot.
+vec4 SampleMaterial(uvec2 slot, bool color, vec2 uv, vec2 dx, vec2 dy, vec4 fallback)
+{
+  if (slot == uvec2(0))
+    return fallback;
+#if BINDLESS_MATERIALS
+  return textureGrad(sampler2D(slot), uv, dx, dy);
+#else
+  vec3 coordinate = vec3(uv, float(slot.x - 1));
+  return color ? textureGrad(ColorTextures, coordinate, dx, dy) : textureGrad(DataTextures, coordinate, dx, dy);
+#endif
+}
+
+// Metal-roughness shading of one material at a surface point, lit by the sun, the clustered
+// lights and the environment.
+vec3 ShadeMaterial(uint index, vec2 uv, vec2 dx, vec2 dy, vec3 N, vec3 V, vec3 positionWS, vec2 fragCoord)
+{
+  Material material = materials[index];
+  vec4 baseColor = material.baseColorFactor * SampleMaterial(material.textures[0], true, uv, dx, dy, vec4(1.0));
+  vec4 metallicRoughness = SampleMaterial(material.textures[1], false, uv, dx, dy, vec4(1.0));
+  float occlusion = mix(1.0, SampleMaterial(material.textures[2], false, uv, dx, dy, vec4(1.0)).r, material.occlusionStrength);
+  vec3 emissive = material.emissiveFactor * SampleMaterial(material.textures[3], true, uv, dx, dy, vec4(1.0)).rgb;
+
+  float roughness = clamp(material.roughnessFactor * metallicRoughness.g, 0.04, 1.0);
+  float metallic = clamp(material.metallicFactor * metallicRoughness.b, 0.0, 1.0);
+  vec3 albedo = baseColor.rgb * (1.0 - metallic);
+  vec3 F0 = mix(vec3(0.04), baseColor.rgb, metallic);
+
+  vec3 L = normalize(Sun.direction);
+  vec3 irradiance = SHIrradiance(N) * occlusion + Sun.color * max(dot(N, L), 0.0);
+  uvec2 cluster = ClusterLights(fragCoord, positionWS);
+  for (uint i = 0; i < cluster.y; ++i)
+  {
+    vec3 radiance = PunctualRadiance(lights[lightIndices[cluster.x + i]], positionWS, L);
+    irradiance += radiance * max(dot(N, L), 0.0);
+  }
+
+  vec3 specular = PrefilteredRadiance(reflect(-V, N), roughness) * EnvBRDFApprox(F0, roughness, max(dot(N, V), 0.0)) * occlusion;
+  return albedo * irradiance + specular + emissive;
+}
@@ -0,0 +1,8 @@
+// Camera and model transforms, MatrixUBO in main.cpp.
+layout(std140, binding = 0) uniform uniforms_t
+{
+  mat4 ViewProjectionMatrix;
+  mat4 ModelMatrix;
+  vec3 CameraPosition;
+  float padding;
+} transform_ub;
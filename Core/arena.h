@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+// Bump allocator for memory that is released all at once, usable by std::pmr containers.
+//
+// Allocation moves an offset through one preallocated block and deallocation does nothing;
+// Reset() or a ScratchScope rewinds the offset. A request that does not fit goes to the heap
+// and the block grows to the high water mark the next time the arena is empty, so an arena
+// with a steady workload stops touching the heap after its first frames.
+//
+// Not thread safe: the arenas below belong to the main thread.
+class LinearArena : public std::pmr::memory_resource
+{
+public:
+	struct Marker
+	{
+		size_t offset = 0;
+		size_t overflows = 0;
+	};
+
+	explicit LinearArena(size_t capacity) : m_Block(std::make_unique<std::byte[]>(capacity)), m_Capacity(capacity) {}
+
+	~LinearArena()
+	{
+		Rewind(Marker());
+	}
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	// Lives until the next frame starts; main() resets it at the top of every frame.
+	static LinearArena& Frame()
+	{
+		static LinearArena* arena = new LinearArena(s_FrameCapacity);
+		return *arena;
+	}
+
+	// Temporaries of a single call, only to be used through a ScratchScope.
+	static LinearArena& Scratch()
+	{
+		static LinearArena* arena = new LinearArena(s_ScratchCapacity);
+		return *arena;
+	}
+
+	// Everything allocated so far becomes invalid.
+	void Reset()
+	{
+		Rewind(Marker());
+	}
+
+	Marker GetMarker() const
+	{
+		return { m_Offset, m_Overflows.size() };
+	}
+
+	// Frees everything allocated after `marker`.
+	void Rewind(const Marker& marker)
+	{
+		for (size_t i = marker.overflows; i < m_Overflows.size(); ++i)
+			std::pmr::new_delete_resource()->deallocate(m_Overflows[i].memory, m_Overflows[i].bytes, m_Overflows[i].alignment);
+		m_Overflows.resize(marker.overflows);
+		m_Offset = marker.offset;
+
+		if (m_Offset == 0 && m_HighWater > m_Capacity)
+		{
+			m_Capacity = m_HighWater + m_HighWater / 2;
+			m_Block = std::make_unique<std::byte[]>(m_Capacity);
+		}
+		m_Demand = m_Offset;
+	}
+
+	size_t GetUsed() const
+	{
+		return m_Offset;
+	}
+
+	size_t GetCapacity() const
+	{
+		return m_Capacity;
+	}
+
+	// The most the arena held at once, heap overflow included.
+	size_t GetHighWater() const
+	{
+		return m_HighWater;
+	}
+
+private:
+	static constexpr size_t s_FrameCapacity = 256 * 1024;
+	static constexpr size_t s_ScratchCapacity = 256 * 1024;
+
+	struct Overflow
+	{
+		void* memory;
+		size_t bytes;
+		size_t alignment;
+	};
+
+	std::unique_ptr<std::byte[]> m_Block;
+	size_t m_Capacity = 0;
+	size_t m_Offset = 0;
+	size_t m_Demand = 0;     // m_Offset plus the overflow since the arena was last empty.
+	size_t m_HighWater = 0;
+	std::vector<Overflow> m_Overflows;
+
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		const size_t offset = (m_Offset + alignment - 1) & ~(alignment - 1);
+		m_Demand += offset - m_Offset + bytes;
+		m_HighWater = std::max(m_HighWater, m_Demand);
+		if (offset + bytes <= m_Capacity)
+		{
+			m_Offset = offset + bytes;
+			return m_Block.get() + offset;
+		}
+
+		void* memory = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		m_Overflows.push_back({ memory, bytes, alignment });
+		return memory;
+	}
+
+	void do_deallocate(void*, size_t, size_t) override
+	{
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// Rewinds LinearArena::Scratch() when it goes out of scope, freeing every allocation made from
+// it meanwhile. Scopes nest; nothing allocated inside may outlive the scope.
+class ScratchScope
+{
+public:
+	ScratchScope() : m_Arena(LinearArena::Scratch()), m_Marker(m_Arena.GetMarker()) {}
+
+	~ScratchScope()
+	{
+		m_Arena.Rewind(m_Marker);
+	}
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	// For std::pmr containers, e.g. std::pmr::vector<int> values(scratch).
+	template<typename T>
+	operator std::pmr::polymorphic_allocator<T>() const
+	{
+		return &m_Arena;
+	}
+
+private:
+	LinearArena& m_Arena;
+	LinearArena::Marker m_Marker;
+};
+
+// Heap allocations made by the calling thread through operator new, which is what containers
+// and strings use. Debug builds replace operator new to count them, so the main loop can show
+// that a warm frame does not allocate; release builds always report 0.
+class HeapCounter
+{
+public:
+#if !defined(NDEBUG)
+	static constexpr bool s_Enabled = true;
+#else
+	static constexpr bool s_Enabled = false;
+#endif
+
+	static uint64_t Get()
+	{
+		return s_Allocations;
+	}
+
+	static void Add()
+	{
+		++s_Allocations;
+	}
+
+private:
+	inline static thread_local uint64_t s_Allocations = 0;
+};
+
+// Replacements of the global operator new, defined here since main.cpp is the only translation
+// unit. The array and nothrow forms call these; over-aligned allocations are not counted.
+#if !defined(NDEBUG)
+void* operator new(std::size_t size)
+{
+	HeapCounter::Add();
+	if (void* memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+#endif
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Deterministic benchmark runs.
+//
+// A script is a list of keyframes, indexed by frame number rather than time, holding the camera
+// position and rotation and the model's yaw. Playback interpolates between them per frame, so
+// every run renders the same images no matter how fast frames complete. Warm-up frames are
+// rendered but not measured.
+//
+//   {
+//     "warmup": 60,
+//     "keyframes": [
+//       { "frame": 0,   "position": [0, 0, 4], "rotation": [1, 0, 0, 0], "model_yaw": 0 },
+//       { "frame": 600, "position": [4, 0, 0], "rotation": [0.92, 0, 0.38, 0], "model_yaw": 180 }
+//     ]
+//   }
+//
+// Rotations are quaternions in [w, x, y, z] order, model_yaw is in degrees.
+class Benchmark
+{
+public:
+	struct Keyframe
+	{
+		uint32_t frame = 0;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		float modelYaw = 0.0f;
+	};
+
+	bool Load(const std::filesystem::path& path)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			LOG_RUNTIME_ERROR("Cannot open benchmark script {}", path.string());
+			return false;
+		}
+
+		nlohmann::json script = nlohmann::json::parse(file, nullptr, false);
+		if (script.is_discarded() || !script.count("keyframes") || !script["keyframes"].is_array() || script["keyframes"].empty())
+		{
+			LOG_RUNTIME_ERROR("Benchmark script {} has no keyframes.", path.string());
+			return false;
+		}
+
+		m_Keyframes.clear();
+		m_Warmup = script.value("warmup", 60u);
+		for (const nlohmann::json& entry : script["keyframes"])
+		{
+			Keyframe keyframe;
+			keyframe.frame = entry.value("frame", 0u);
+			if (entry.count("position"))
+				keyframe.position = glm::vec3(entry["position"][0].get<float>(), entry["position"][1].get<float>(), entry["position"][2].get<float>());
+			if (entry.count("rotation"))
+				keyframe.rotation = glm::normalize(glm::quat(entry["rotation"][0].get<float>(), entry["rotation"][1].get<float>(), entry["rotation"][2].get<float>(), entry["rotation"][3].get<float>()));
+			keyframe.modelYaw = entry.value("model_yaw", 0.0f);
+			m_Keyframes.push_back(keyframe);
+		}
+		std::sort(m_Keyframes.begin(), m_Keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+
+		m_Script = path.string();
+		LOG_RUNTIME_INFO("Benchmark script {} loaded: {} keyframes, {} frames.", m_Script, m_Keyframes.size(), GetMeasuredFrames());
+		return true;
+	}
+
+	// One orbit around the origin while the model turns half way, looking slightly down.
+	void UseDefaultPath(uint32_t frames)
+	{
+		m_Keyframes.clear();
+		m_Warmup = 60;
+		m_Script = "default orbit";
+
+		const uint32_t steps = 16;
+		for (uint32_t i = 0; i <= steps; ++i)
+		{
+			float t = static_cast<float>(i) / steps;
+			float angle = glm::two_pi<float>() * t;
+
+			Keyframe keyframe;
+			keyframe.frame = static_cast<uint32_t>(t * frames);
+			keyframe.position = glm::vec3(glm::sin(angle) * 4.0f, 1.0f, glm::cos(angle) * 4.0f);
+			keyframe.rotation = glm::quatLookAt(glm::normalize(-keyframe.position), glm::vec3(0.0f, 1.0f, 0.0f));
+			keyframe.modelYaw = 180.0f * t;
+			m_Keyframes.push_back(keyframe);
+		}
+	}
+
+	uint32_t GetMeasuredFrames() const
+	{
+		return m_Keyframes.empty() ? 0 : m_Keyframes.back().frame + 1;
+	}
+
+	uint32_t GetTotalFrames() const
+	{
+		return m_Warmup + GetMeasuredFrames();
+	}
+
+	// Poses the camera and the model for a frame; warm-up frames hold the first keyframe.
+	void Apply(uint64_t frameIndex, Camera& camera, glm::quat& model) const
+	{
+		uint32_t frame = frameIndex < m_Warmup ? 0 : static_cast<uint32_t>(frameIndex - m_Warmup);
+
+		auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), frame, [](uint32_t value, const Keyframe& keyframe) { return value < keyframe.frame; });
+		const Keyframe& b = next == m_Keyframes.end() ? m_Keyframes.back() : *next;
+		const Keyframe& a = next == m_Keyframes.begin() ? m_Keyframes.front() : *(next - 1);
+		float t = b.frame > a.frame ? static_cast<float>(frame - a.frame) / (b.frame - a.frame) : 0.0f;
+		t = glm::clamp(t, 0.0f, 1.0f);
+
+		camera.SetPosition(glm::mix(a.position, b.position, t));
+		camera.SetRotation(glm::slerp(a.rotation, b.rotation, t));
+		model = glm::angleAxis(glm::radians(glm::mix(a.modelYaw, b.modelYaw, t)), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	// Wall time from the start of one frame to the start of the next, or to the end of the loop
+	// for the last one.
+	void AddFrameTime(uint64_t frameIndex, double milliseconds)
+	{
+		if (frameIndex >= m_Warmup)
+			m_FrameMs.push_back(milliseconds);
+	}
+
+	// Profiler read back: the first scope is the whole frame, depth 1 scopes are passes.
+	void AddProfilerFrame(uint64_t frameIndex, const std::vector<Profiler::ScopeResult>& results)
+	{
+		if (frameIndex < m_Warmup || results.empty())
+			return;
+
+		m_CpuMs.push_back(results.front().cpuMs);
+		m_GpuMs.push_back(results.front().gpuMs);
+		for (const Profiler::ScopeResult& result : results)
+			if (result.depth == 1)
+				m_PassGpuMs[result.name].push_back(result.gpuMs);
+	}
+
+	// Renderer configuration reported with the results, so runs of different modes can be compared.
+	void SetSetting(const std::string& name, const nlohmann::json& value)
+	{
+		m_Settings[name] = value;
+	}
+
+	nlohmann::json Summarize(int width, int height) const
+	{
+		nlohmann::json summary;
+		summary["script"] = m_Script;
+		summary["vendor"] = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+		summary["renderer"] = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		summary["version"] = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+		summary["resolution"] = { width, height };
+		summary["settings"] = m_Settings;
+		summary["warmup_frames"] = m_Warmup;
+		summary["measured_frames"] = GetMeasuredFrames();
+		summary["frame_ms"] = Statistics(m_FrameMs);
+		summary["cpu_ms"] = Statistics(m_CpuMs);
+		summary["gpu_ms"] = Statistics(m_GpuMs);
+		for (const auto& [name, samples] : m_PassGpuMs)
+			summary["passes_gpu_ms"][name] = Statistics(samples);
+		return summary;
+	}
+
+	// Writes the summary to a file, or to stdout when no path is given. Benchmark runs log to
+	// stderr, so stdout then holds only the JSON.
+	void WriteSummary(const std::filesystem::path& path, int width, int height) const
+	{
+		std::string text = Summarize(width, height).dump(2);
+		if (path.empty())
+		{
+			std::cout << text << std::endl;
+			return;
+		}
+
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		file << text << '\n';
+		LOG_RUNTIME_INFO("Benchmark summary written to {}", path.string());
+	}
+
+private:
+	std::vector<Keyframe> m_Keyframes;
+	uint32_t m_Warmup = 60;
+	std::string m_Script;
+	nlohmann::json m_Settings = nlohmann::json::object();
+
+	std::vector<double> m_FrameMs, m_CpuMs, m_GpuMs;
+	std::map<std::string, std::vector<double>> m_PassGpuMs;
+
+	// Nearest-rank percentiles.
+	static nlohmann::json Statistics(std::vector<double> samples)
+	{
+		nlohmann::json stats;
+		stats["samples"] = samples.size();
+		if (samples.empty())
+			return stats;
+
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&samples](double p)
+		{
+			size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+			return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+		};
+
+		double sum = 0.0;
+		for (double sample : samples)
+			sum += sample;
+
+		stats["mean"] = sum / samples.size();
+		stats["p50"] = percentile(50.0);
+		stats["p95"] = percentile(95.0);
+		stats["p99"] = percentile(99.0);
+		stats["max"] = samples.back();
+		return stats;
+	}
+};
+
+// Records the interactive camera and model every frame as a benchmark script.
+class BenchmarkRecorder
+{
+public:
+	void Record(Camera& camera, const glm::quat& model)
+	{
+		glm::quat rotation = camera.GetRotation();
+		glm::vec3 position = camera.GetPosition();
+		// Yaw of the model around +Y, which is the only rotation the viewer applies to it.
+		float modelYaw = glm::degrees(2.0f * std::atan2(model.y, model.w));
+
+		nlohmann::json keyframe;
+		keyframe["frame"] = m_Frame++;
+		keyframe["position"] = { position.x, position.y, position.z };
+		keyframe["rotation"] = { rotation.w, rotation.x, rotation.y, rotation.z };
+		keyframe["model_yaw"] = modelYaw;
+		m_Keyframes.push_back(keyframe);
+	}
+
+	void Save(const std::filesystem::path& path) const
+	{
+		nlohmann::json script;
+		script["warmup"] = 60;
+		script["keyframes"] = m_Keyframes;
+
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		file << script.dump(1) << '\n';
+		LOG_RUNTIME_INFO("Benchmark script with {} frames recorded to {}", m_Frame, path.string());
+	}
+
+private:
+	uint32_t m_Frame = 0;
+	nlohmann::json m_Keyframes = nlohmann::json::array();
+};
@@ -11,6 +11,8 @@
 #include <glm/gtx/quaternion.hpp> // glm::toMat
 
 
+// The view, rotation and view-projection matrices are cached and only rebuilt on the first
+// request after the position, rotation or projection changed.
 class Camera
 {
 public:
@@ -20,24 +22,38 @@ public:
 		return *instance;
 	}
 
-	glm::mat4 GetViewMatrix()
+	const glm::mat4& GetViewMatrix()
 	{
-		return glm::inverse(glm::translate(glm::mat4(1.0f), m_Position) * glm::toMat4(m_Rotation));
+		UpdateMatrices();
+		return m_ViewMatrix;
 	}
 
-	glm::mat4 GetProjectionMatrix()
+	const glm::mat4& GetProjectionMatrix()
 	{
 		return m_ProjectionMatrix;
 	}
 
-	glm::mat4 GetViewProjection()
+	const glm::mat4& GetViewProjection()
 	{
-		return m_ProjectionMatrix * GetViewMatrix();
+		UpdateMatrices();
+		return m_ViewProjection;
 	}
 
-	glm::mat4 GetRotationMatrix()
+	// The inverse rotation, the view matrix without the translation.
+	const glm::mat4& GetRotationMatrix()
 	{
-		return glm::inverse(toMat4(m_Rotation));
+		UpdateMatrices();
+		return m_RotationMatrix;
+	}
+
+	float GetNear() const
+	{
+		return m_Near;
+	}
+
+	float GetFar() const
+	{
+		return m_Far;
 	}
 
 	glm::vec3 GetPosition()
@@ -45,45 +61,68 @@ public:
 		return m_Position;
 	}
 
+	glm::quat GetRotation()
+	{
+		return m_Rotation;
+	}
+
+	Camera& SetPosition(const glm::vec3& position)
+	{
+		if (m_Position != position)
+		{
+			m_Position = position;
+			m_Dirty = true;
+		}
+		return Instance();
+	}
+
+	Camera& SetRotation(const glm::quat& rotation)
+	{
+		if (m_Rotation != rotation)
+		{
+			m_Rotation = rotation;
+			m_Dirty = true;
+		}
+		return Instance();
+	}
+
 	Camera& SetFoV(float vfov)
 	{
 		m_VFoV = vfov;
-		m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, 0.1f, 10000.0f);
+		m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, m_Near, m_Far);
+		m_Dirty = true;
 		return Instance();
 	}
 
 	Camera& SetAspect(int width, int height)
 	{
 		m_Aspect = static_cast<float>(width) / height;
-		m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, 0.1f, 10000.0f);
+		m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, m_Near, m_Far);
+		m_Dirty = true;
 		return Instance();
 	}
 
 	Camera& MoveForward(float offset)
 	{
 		glm::vec3 direction = m_Rotation * glm::vec3(0.0f, 0.0f, -1.0f);
-		m_Position += direction * offset;
-		return Instance();
+		return SetPosition(m_Position + direction * offset);
 	}
 
 	Camera& MoveRight(float offset)
 	{
 		glm::vec3 direction = m_Rotation * glm::vec3(1.0f, 0.0f, 0.0f);
-		m_Position += direction * offset;
-		return Instance();
+		return SetPosition(m_Position + direction * offset);
 	}
 
 	Camera& MoveUp(float offset)
 	{
 		glm::vec3 direction = m_Rotation * glm::vec3(0.0f, 1.0f, 0.0f);
-		m_Position += direction * offset;
-		return Instance();
+		return SetPosition(m_Position + direction * offset);
 	}
 
 	Camera& Rotate(float pitch, float yaw)
 	{
-		m_Rotation = glm::angleAxis(glm::radians(-yaw * 0.1f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(m_Rotation, glm::radians(pitch * 0.1f), glm::vec3(1.0f, 0.0f, 0.0f));
-		return Instance();
+		return SetRotation(glm::angleAxis(glm::radians(-yaw * 0.1f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(m_Rotation, glm::radians(pitch * 0.1f), glm::vec3(1.0f, 0.0f, 0.0f)));
 	}
 
 private:
@@ -93,6 +132,26 @@ private:
 	glm::vec3 m_Position = glm::vec3(0.0f);
 	glm::quat m_Rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 
-	glm::mat4 m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, 0.1f, 1000.0f);
+	float m_Near = 0.1f;
+	float m_Far = 10000.0f;
+
+	glm::mat4 m_ProjectionMatrix = glm::perspective(m_VFoV, m_Aspect, m_Near, m_Far);
+
+	bool m_Dirty = true;
+	glm::mat4 m_ViewMatrix = glm::mat4(1.0f);
+	glm::mat4 m_RotationMatrix = glm::mat4(1.0f);
+	glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+
+	// The rotation is orthonormal, so the inverse of translate * rotate is the transposed
+	// rotation, taken from the conjugate quaternion, times the negated translation.
+	void UpdateMatrices()
+	{
+		if (!m_Dirty)
+			return;
+		m_RotationMatrix = glm::toMat4(glm::conjugate(m_Rotation));
+		m_ViewMatrix = glm::translate(m_RotationMatrix, -m_Position);
+		m_ViewProjection = m_ProjectionMatrix * m_ViewMatrix;
+		m_Dirty = false;
+	}
 };
 
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A file compiled into the executable.
+struct EmbeddedFile
+{
+	const char* name;
+	const char* data;
+	size_t size;
+
+	std::string_view GetText() const
+	{
+		return std::string_view(data, size);
+	}
+};
+
+// Assets/Shaders/ as of the last build. The Core pre-build step runs
+// `ShaderCompiler --embed Core/Generated/embeddedshaders.inl`, which only rewrites the file when
+// a shader changed, so unchanged shaders do not rebuild main.cpp. Without the generated file the
+// table is empty and shaders always come from disk.
+#if __has_include("Generated/embeddedshaders.inl")
+#include "Generated/embeddedshaders.inl"
+#else
+inline constexpr EmbeddedFile s_EmbeddedShaders[] = { { nullptr, nullptr, 0 } };
+#endif
+
+// Lookup in a table ending with a null name, by the path relative to the embedded folder.
+inline const EmbeddedFile* FindEmbeddedFile(const EmbeddedFile* files, const std::string& name)
+{
+	for (; files->name; ++files)
+		if (name == files->name)
+			return files;
+	return nullptr;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Offscreen color target plus asynchronous readback to disk.
+//
+// Capture() copies the target into one of a ring of pixel pack buffers and fences it. The
+// buffer is only mapped once its fence has signaled, normally a couple of frames later, so
+// writing frames does not stall the GPU. Frames are written as binary PPM (P6), top row first.
+class FrameWriter
+{
+public:
+	FrameWriter(int width, int height, const std::filesystem::path& folder) : m_Width(width), m_Height(height), m_Folder(folder)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_Texture);
+		glTextureStorage2D(m_Texture, 1, GL_RGBA8, m_Width, m_Height);
+
+		m_Size = static_cast<GLsizeiptr>(m_Width) * m_Height * 4;
+		for (Pending& pending : m_Pending)
+		{
+			glCreateBuffers(1, &pending.buffer);
+			glNamedBufferStorage(pending.buffer, m_Size, nullptr, GL_MAP_READ_BIT);
+		}
+
+		if (!m_Folder.empty() && !std::filesystem::exists(m_Folder))
+			std::filesystem::create_directories(m_Folder);
+	}
+
+	~FrameWriter()
+	{
+		Flush();
+		for (Pending& pending : m_Pending)
+			glDeleteBuffers(1, &pending.buffer);
+		glDeleteTextures(1, &m_Texture);
+	}
+
+	GLuint GetTexture() const
+	{
+		return m_Texture;
+	}
+
+	// Starts the readback of the target as frame index `frame` and writes any finished ones.
+	void Capture(uint64_t frame)
+	{
+		Retire(false);
+
+		Pending& pending = m_Pending[m_Next];
+		m_Next = (m_Next + 1) % s_Slots;
+		if (pending.fence)
+			Write(pending, true);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.buffer);
+		glGetTextureImage(m_Texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(m_Size), nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending.frame = frame;
+	}
+
+	// Waits for and writes every outstanding frame.
+	void Flush()
+	{
+		Retire(true);
+	}
+
+private:
+	struct Pending
+	{
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		uint64_t frame = 0;
+	};
+
+	static constexpr int s_Slots = 3;
+
+	int m_Width, m_Height;
+	GLsizeiptr m_Size = 0;
+	std::filesystem::path m_Folder;
+	GLuint m_Texture = 0;
+	Pending m_Pending[s_Slots];
+	int m_Next = 0;
+	std::vector<unsigned char> m_Row;
+
+	// Writes the finished frames in submission order; stops at the first one still in flight.
+	void Retire(bool wait)
+	{
+		for (int i = 0; i < s_Slots; ++i)
+		{
+			Pending& pending = m_Pending[(m_Next + i) % s_Slots];
+			if (pending.fence && !Write(pending, wait))
+				break;
+		}
+	}
+
+	bool Write(Pending& pending, bool wait)
+	{
+		GLenum status = glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+			return false;
+		glDeleteSync(pending.fence);
+		pending.fence = nullptr;
+
+		char filename[32];
+		snprintf(filename, sizeof(filename), "frame_%05llu.ppm", static_cast<unsigned long long>(pending.frame));
+		std::filesystem::path path = m_Folder / filename;
+
+		const unsigned char* pixels = static_cast<const unsigned char*>(glMapNamedBufferRange(pending.buffer, 0, m_Size, GL_MAP_READ_BIT));
+		if (!pixels)
+		{
+			LOG_RUNTIME_ERROR("Cannot map readback buffer for {}", path.string());
+			return true;
+		}
+
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+		file << "P6\n" << m_Width << ' ' << m_Height << "\n255\n";
+		m_Row.resize(static_cast<size_t>(m_Width) * 3);
+		// OpenGL rows start at the bottom.
+		for (int y = m_Height - 1; y >= 0; --y)
+		{
+			const unsigned char* src = pixels + static_cast<size_t>(y) * m_Width * 4;
+			for (int x = 0; x < m_Width; ++x)
+			{
+				m_Row[x * 3 + 0] = src[x * 4 + 0];
+				m_Row[x * 3 + 1] = src[x * 4 + 1];
+				m_Row[x * 3 + 2] = src[x * 4 + 2];
+			}
+			file.write(reinterpret_cast<const char*>(m_Row.data()), m_Row.size());
+		}
+		file.close();
+		glUnmapNamedBuffer(pending.buffer);
+
+		LOG_RUNTIME_INFO("Frame written to {}", path.string());
+		return true;
+	}
+};
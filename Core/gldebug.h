@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+
+// GL debug output of the debug profile, deduplicated and rate limited by message ID.
+//
+// The first message of an ID is logged in full. Repeats are only counted, and at most once per
+// s_RepeatInterval the latest one is logged again with the number that were skipped, so an error
+// inside a per-frame draw costs a counter increment instead of a log line each frame. The
+// counters of every ID are shown by DrawTable(). IDs past the first s_MaxIds share one "Other"
+// entry, and with it one rate limit.
+//
+// Output is synchronous, so the callback runs on the thread that made the failing call and a
+// debugger break lands on it; the GL context is only current on the main thread.
+class GLDebugOutput
+{
+public:
+	static constexpr std::chrono::seconds s_RepeatInterval{ 1 };
+	static constexpr size_t s_MaxIds = 256;
+
+	// Needs a debug context. Returns false without one.
+	bool Enable()
+	{
+		GLint flags = 0; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+		if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+			return false;
+
+		glEnable(GL_DEBUG_OUTPUT);
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		glDebugMessageCallback(Callback, this);
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+
+		// Known noise, muted in the driver so it never reaches the callback: buffer and texture
+		// placement notes (131169, 131185, 131204) and a shader recompile hint (131218).
+		const GLuint ignored[] = { 131169, 131185, 131204, 131218 };
+		for (GLenum type : { GL_DEBUG_TYPE_OTHER, GL_DEBUG_TYPE_PERFORMANCE })
+			glDebugMessageControl(GL_DEBUG_SOURCE_API, type, GL_DONT_CARE, static_cast<GLsizei>(std::size(ignored)), ignored, GL_FALSE);
+
+		m_Enabled = true;
+		return true;
+	}
+
+	bool IsEnabled() const
+	{
+		return m_Enabled;
+	}
+
+	void DrawTable() const
+	{
+		ImGui::Text("GL debug messages: %llu, %llu logged", static_cast<unsigned long long>(m_Received), static_cast<unsigned long long>(m_Logged));
+		if (m_Count == 0 || !ImGui::BeginTable("GL debug", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+			return;
+
+		ImGui::TableSetupColumn("ID");
+		ImGui::TableSetupColumn("Type");
+		ImGui::TableSetupColumn("Severity");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableHeadersRow();
+		for (size_t i = 0; i <= m_Count; ++i)
+		{
+			const Entry& entry = i < m_Count ? m_Entries[i] : m_Overflow;
+			if (entry.count == 0)
+				continue;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			if (&entry == &m_Overflow)
+				ImGui::TextUnformatted("Other");
+			else
+				ImGui::Text("%u", entry.id);
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(GetTypeName(entry.type));
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(GetSeverityName(entry.severity));
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(entry.count));
+		}
+		ImGui::EndTable();
+	}
+
+private:
+	struct Entry
+	{
+		GLuint id = 0;
+		GLenum source = 0, type = 0, severity = 0;
+		uint64_t count = 0;
+		uint64_t skipped = 0;  // Since it was last logged.
+		std::chrono::steady_clock::time_point lastLogged;
+	};
+
+	bool m_Enabled = false;
+	Entry m_Entries[s_MaxIds];
+	size_t m_Count = 0;
+	Entry m_Overflow;  // Every ID past the first s_MaxIds, counted and rate limited together.
+	uint64_t m_Received = 0;
+	uint64_t m_Logged = 0;
+
+	static void APIENTRY Callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+	{
+		static_cast<GLDebugOutput*>(const_cast<void*>(userParam))->Receive(source, type, id, severity, message);
+	}
+
+	void Receive(GLenum source, GLenum type, GLuint id, GLenum severity, const GLchar* message)
+	{
+		++m_Received;
+		auto now = std::chrono::steady_clock::now();
+
+		// IDs are only unique per source and type.
+		Entry* entry = std::find_if(m_Entries, m_Entries + m_Count, [&](const Entry& e) { return e.id == id && e.source == source && e.type == type; });
+		bool first = entry == m_Entries + m_Count;
+		if (first && m_Count < s_MaxIds)
+		{
+			entry = &m_Entries[m_Count++];
+			entry->id = id;
+			entry->source = source;
+			entry->type = type;
+		}
+		else if (first)
+		{
+			entry = &m_Overflow;
+			first = m_Overflow.count == 0;
+		}
+		entry->severity = severity;
+		++entry->count;
+
+		if (!first && now - entry->lastLogged < s_RepeatInterval)
+		{
+			++entry->skipped;
+			return;
+		}
+
+		spdlog::level::level_enum level = GetLogLevel(severity);
+		if (entry->skipped)
+			SPDLOG_LOGGER_CALL(Logger::OpenGL(), level, "Debug message {} ({} repeats skipped): {}\nSource: {}, type: {}, severity: {}", id, entry->skipped, message, GetSourceName(source), GetTypeName(type), GetSeverityName(severity));
+		else
+			SPDLOG_LOGGER_CALL(Logger::OpenGL(), level, "Debug message {}: {}\nSource: {}, type: {}, severity: {}", id, message, GetSourceName(source), GetTypeName(type), GetSeverityName(severity));
+		entry->skipped = 0;
+		entry->lastLogged = now;
+		++m_Logged;
+	}
+
+	static spdlog::level::level_enum GetLogLevel(GLenum severity)
+	{
+		switch (severity)
+		{
+		case GL_DEBUG_SEVERITY_HIGH:   return spdlog::level::err;
+		case GL_DEBUG_SEVERITY_MEDIUM: return spdlog::level::warn;
+		case GL_DEBUG_SEVERITY_LOW:    return spdlog::level::info;
+		default:                       return spdlog::level::debug;
+		}
+	}
+
+	static const char* GetSourceName(GLenum source)
+	{
+		switch (source)
+		{
+		case GL_DEBUG_SOURCE_API:             return "API";
+		case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "Window System";
+		case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+		case GL_DEBUG_SOURCE_THIRD_PARTY:     return "Third Party";
+		case GL_DEBUG_SOURCE_APPLICATION:     return "Application";
+		default:                              return "Other";
+		}
+	}
+
+	static const char* GetTypeName(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_DEBUG_TYPE_ERROR:               return "Error";
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated Behaviour";
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "Undefined Behaviour";
+		case GL_DEBUG_TYPE_PORTABILITY:         return "Portability";
+		case GL_DEBUG_TYPE_PERFORMANCE:         return "Performance";
+		case GL_DEBUG_TYPE_MARKER:              return "Marker";
+		case GL_DEBUG_TYPE_PUSH_GROUP:          return "Push Group";
+		case GL_DEBUG_TYPE_POP_GROUP:           return "Pop Group";
+		default:                                return "Other";
+		}
+	}
+
+	static const char* GetSeverityName(GLenum severity)
+	{
+		switch (severity)
+		{
+		case GL_DEBUG_SEVERITY_HIGH:         return "high";
+		case GL_DEBUG_SEVERITY_MEDIUM:       return "medium";
+		case GL_DEBUG_SEVERITY_LOW:          return "low";
+		default:                             return "notification";
+		}
+	}
+};
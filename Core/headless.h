@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstring>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_CONTEXT_OPENGL_NO_ERROR_KHR
+#define EGL_CONTEXT_OPENGL_NO_ERROR_KHR 0x31B3
+#endif
+#endif
+
+// An OpenGL context without a visible surface, for render servers and CI.
+//
+// On Linux this is a surfaceless EGL display (EGL_MESA_platform_surfaceless), which needs no X
+// or Wayland server. Elsewhere it falls back to an invisible GLFW window. Either way all
+// rendering goes to framebuffer objects.
+//
+// Only Core.vcxproj is built so far, which takes the GLFW path; the EGL path is for a Linux
+// build linking libEGL. The renderer needs GL_NV_mesh_shader in both cases, so a context on a
+// software rasterizer such as Mesa llvmpipe is refused at startup, see main().
+class HeadlessContext
+{
+public:
+	~HeadlessContext()
+	{
+		Destroy();
+	}
+
+	bool Create(int major, int minor, GLProfile profile)
+	{
+		const bool debug = profile == GLProfile::Debug;
+#if defined(__linux__)
+		auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (!getPlatformDisplay)
+		{
+			LOG_RUNTIME_ERROR("EGL_EXT_platform_base is not supported.");
+			return false;
+		}
+
+		m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		EGLint eglMajor = 0, eglMinor = 0;
+		if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &eglMajor, &eglMinor))
+		{
+			LOG_RUNTIME_ERROR("failed to initialize a surfaceless EGL display.");
+			return false;
+		}
+		LOG_RUNTIME_INFO("EGL {0}.{1} ({2})", eglMajor, eglMinor, eglQueryString(m_Display, EGL_VENDOR));
+
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			LOG_RUNTIME_ERROR("EGL does not support desktop OpenGL.");
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLConfig config = nullptr;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(m_Display, configAttributes, &config, 1, &configCount) || configCount == 0)
+		{
+			LOG_RUNTIME_ERROR("No EGL config supports desktop OpenGL.");
+			return false;
+		}
+
+		// A no-error context needs EGL_KHR_create_context_no_error, without it production is a plain context.
+		const char* extensions = eglQueryString(m_Display, EGL_EXTENSIONS);
+		const bool noError = !debug && extensions && strstr(extensions, "EGL_KHR_create_context_no_error");
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, major,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE,
+			EGL_CONTEXT_OPENGL_NO_ERROR_KHR, noError ? EGL_TRUE : EGL_FALSE,
+			EGL_NONE
+		};
+		m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (m_Context == EGL_NO_CONTEXT)
+		{
+			LOG_RUNTIME_ERROR("failed to create an OpenGL {0}.{1} EGL context.", major, minor);
+			return false;
+		}
+
+		// EGL_KHR_surfaceless_context: current without any surface, the default framebuffer is incomplete.
+		if (!eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context))
+		{
+			LOG_RUNTIME_ERROR("failed to make the surfaceless EGL context current.");
+			return false;
+		}
+		return true;
+#else
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GL_TRUE : GL_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_NO_ERROR, debug ? GLFW_FALSE : GLFW_TRUE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		m_Window = glfwCreateWindow(1, 1, "Ivysaur (headless)", nullptr, nullptr);
+		if (!m_Window)
+		{
+			LOG_RUNTIME_ERROR("failed to create a hidden window.");
+			return false;
+		}
+		glfwMakeContextCurrent(m_Window);
+		return true;
+#endif
+	}
+
+	// The loader entry point matching the context.
+	GL3WGetProcAddressProc GetProcAddress() const
+	{
+#if defined(__linux__)
+		return reinterpret_cast<GL3WGetProcAddressProc>(eglGetProcAddress);
+#else
+		return reinterpret_cast<GL3WGetProcAddressProc>(glfwGetProcAddress);
+#endif
+	}
+
+	void Destroy()
+	{
+#if defined(__linux__)
+		if (m_Display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (m_Context != EGL_NO_CONTEXT)
+				eglDestroyContext(m_Display, m_Context);
+			eglTerminate(m_Display);
+		}
+		m_Context = EGL_NO_CONTEXT;
+		m_Display = EGL_NO_DISPLAY;
+#else
+		if (m_Window)
+			glfwDestroyWindow(m_Window);
+		m_Window = nullptr;
+#endif
+	}
+
+private:
+#if defined(__linux__)
+	EGLDisplay m_Display = EGL_NO_DISPLAY;
+	EGLContext m_Context = EGL_NO_CONTEXT;
+#else
+	GLFWwindow* m_Window = nullptr;
+#endif
+};
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Image based lighting from the skybox, computed once per environment.
+//
+// The specular term is a GGX prefiltered cube map whose mip levels go from roughness 0 to 1, the
+// diffuse term order 2 spherical harmonics of the cosine convolved radiance. Both come from
+// ibl_prefilter.comp and ibl_irradiance.comp, or from a slower CPU path for headless runs and
+// drivers without working compute programs. The results are cached in Assets/TextureCache/ under
+// a hash of the source images: the prefiltered map as BC6H, the harmonics as a raw .sh file.
+// The hash also covers the path that computed them, with the compute shader sources or the
+// CPU parameters, so a low quality CPU result never stands in for a GPU one.
+//
+// Bindings: prefiltered cube map on unit 5, irradiance UBO 4; the source is read from unit 6.
+class EnvironmentLighting
+{
+public:
+	static constexpr int s_SpecularSize = 256;
+	static constexpr int s_SpecularLevels = 6;
+	// The CPU path prefilters a smaller map with fewer samples.
+	static constexpr int s_CpuSpecularSize = 64;
+	static constexpr int s_CpuSpecularLevels = 4;
+	static constexpr uint32_t s_CpuSampleCount = 32;
+	// Largest source mip used for the harmonics, it has no high frequency detail to keep.
+	static constexpr int s_IrradianceSize = 64;
+
+	// std140 layout shared with the lighting shaders, RGB in xyz.
+	struct IrradianceUBO
+	{
+		glm::vec4 SH[9];
+	};
+
+	EnvironmentLighting()
+	{
+		glCreateBuffers(1, &m_Irradiance);
+		glNamedBufferStorage(m_Irradiance, sizeof(IrradianceUBO), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	~EnvironmentLighting()
+	{
+		glDeleteBuffers(1, &m_Irradiance);
+		glDeleteTextures(1, &m_Specular);
+	}
+
+	// `source` is the mipmapped skybox, `sources` the files it was loaded from. Compute programs
+	// are used when `useCompute` is set and both linked.
+	void Create(GLuint source, const std::vector<std::filesystem::path>& sources, Program& prefilter, Program& irradiance, bool useCompute)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		uint64_t sourceHash = 14695981039346656037ull;
+		for (const std::filesystem::path& file : sources)
+			sourceHash = TextureCache::HashFile(file, sourceHash);
+		const uint32_t gpuParameters[] = { s_SpecularSize, s_SpecularLevels, s_IrradianceSize };
+		const uint64_t gpuHash = irradiance.HashSources(prefilter.HashSources(ProgramCache::HashBytes(gpuParameters, sizeof(gpuParameters), sourceHash)));
+		const uint32_t cpuParameters[] = { s_CpuSpecularSize, s_CpuSpecularLevels, s_CpuSampleCount, s_IrradianceSize };
+		const uint64_t cpuHash = ProgramCache::HashBytes(cpuParameters, sizeof(cpuParameters), sourceHash);
+
+		// The CPU path takes GPU results too when a previous run left some.
+		useCompute = useCompute && prefilter.IsLinked() && irradiance.IsLinked();
+		const uint64_t hash = useCompute ? gpuHash : cpuHash;
+		for (uint64_t candidate : { gpuHash, cpuHash })
+		{
+			std::filesystem::path specularPath = TextureCache::GetPath("ibl_specular", candidate);
+			if (LoadIrradiance(TextureCache::GetPath("ibl_irradiance", candidate, ".sh")) && (m_Specular = TextureCache::Load(specularPath)) != 0)
+			{
+				SetSampling(m_Specular);
+				auto end = std::chrono::high_resolution_clock::now();
+				LOG_RUNTIME_INFO("Environment lighting loaded from {} in {:.1f} ms", specularPath.string(), std::chrono::duration<double, std::milli>(end - start).count());
+				return;
+			}
+			if (candidate == hash)
+				break;
+		}
+		std::filesystem::path specularPath = TextureCache::GetPath("ibl_specular", hash);
+		std::filesystem::path irradiancePath = TextureCache::GetPath("ibl_irradiance", hash, ".sh");
+
+		glDeleteTextures(1, &m_Specular);
+		IrradianceUBO coefficients;
+		if (useCompute)
+		{
+			m_Specular = PrefilterOnGpu(source, prefilter);
+			coefficients = IrradianceOnGpu(source, irradiance);
+		}
+		else
+		{
+			m_Specular = PrefilterOnCpu(source, coefficients);
+		}
+		glNamedBufferSubData(m_Irradiance, 0, sizeof(IrradianceUBO), &coefficients);
+		SetSampling(m_Specular);
+
+		auto end = std::chrono::high_resolution_clock::now();
+		LOG_RUNTIME_INFO("Environment lighting computed on the {} in {:.1f} ms", useCompute ? "GPU" : "CPU", std::chrono::duration<double, std::milli>(end - start).count());
+
+		SaveIrradiance(irradiancePath, coefficients);
+		if (TextureCache::Cook(m_Specular, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, specularPath))
+		{
+			GLuint compressed = TextureCache::Load(specularPath);
+			if (compressed)
+			{
+				glDeleteTextures(1, &m_Specular);
+				m_Specular = compressed;
+				SetSampling(m_Specular);
+			}
+		}
+	}
+
+	void Bind() const
+	{
+		glBindTextureUnit(5, m_Specular);
+		glBindBufferBase(GL_UNIFORM_BUFFER, 4, m_Irradiance);
+	}
+
+	GLuint GetSpecular() const
+	{
+		return m_Specular;
+	}
+
+private:
+	static constexpr uint32_t s_IrradianceMagic = 0x48534C49; // "ILSH"
+
+	// One cube map level read back for the CPU path, faces in GL order.
+	struct CpuLevel
+	{
+		int size = 0;
+		std::vector<glm::vec4> texels;
+	};
+
+	GLuint m_Irradiance = 0;
+	GLuint m_Specular = 0;
+
+	static void SetSampling(GLuint textureID)
+	{
+		glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+	bool LoadIrradiance(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		uint32_t magic = 0;
+		IrradianceUBO coefficients;
+		if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != s_IrradianceMagic
+			|| !file.read(reinterpret_cast<char*>(&coefficients), sizeof(coefficients)))
+			return false;
+		glNamedBufferSubData(m_Irradiance, 0, sizeof(IrradianceUBO), &coefficients);
+		return true;
+	}
+
+	static void SaveIrradiance(const std::filesystem::path& path, const IrradianceUBO& coefficients)
+	{
+		TextureCache::CreateFolder();
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+		file.write(reinterpret_cast<const char*>(&s_IrradianceMagic), sizeof(s_IrradianceMagic));
+		file.write(reinterpret_cast<const char*>(&coefficients), sizeof(coefficients));
+	}
+
+	static GLint GetLevelCount(GLuint textureID)
+	{
+		GLint levels = 0;
+		glGetTextureParameteriv(textureID, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+		return std::max(levels, 1);
+	}
+
+	// First level of `textureID` no larger than `size`.
+	static GLint FindLevel(GLuint textureID, int size)
+	{
+		GLint width = 0;
+		glGetTextureLevelParameteriv(textureID, 0, GL_TEXTURE_WIDTH, &width);
+		GLint level = 0;
+		while ((width >> level) > size && level + 1 < GetLevelCount(textureID))
+			++level;
+		return level;
+	}
+
+	static GLuint PrefilterOnGpu(GLuint source, Program& prefilter)
+	{
+		GLuint textureID;
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+		glTextureStorage2D(textureID, s_SpecularLevels, GL_RGBA16F, s_SpecularSize, s_SpecularSize);
+
+		prefilter.Use();
+		glBindTextureUnit(6, source);
+		for (int level = 0; level < s_SpecularLevels; ++level)
+		{
+			int size = s_SpecularSize >> level;
+			glProgramUniform1f(prefilter.GetStageID(GL_COMPUTE_SHADER), 0, static_cast<float>(level) / (s_SpecularLevels - 1));
+			glBindImageTexture(0, textureID, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+			glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+		return textureID;
+	}
+
+	IrradianceUBO IrradianceOnGpu(GLuint source, Program& irradiance)
+	{
+		irradiance.Use();
+		glBindTextureUnit(6, source);
+		glProgramUniform1f(irradiance.GetStageID(GL_COMPUTE_SHADER), 0, static_cast<float>(FindLevel(source, s_IrradianceSize)));
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_Irradiance);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_UNIFORM_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		IrradianceUBO coefficients;
+		glGetNamedBufferSubData(m_Irradiance, 0, sizeof(IrradianceUBO), &coefficients);
+		return coefficients;
+	}
+
+	// Same face convention as CubeDirection in the compute shaders; `st` is in [-1, 1].
+	static glm::vec3 CubeDirection(int face, glm::vec2 st)
+	{
+		switch (face)
+		{
+		case 0:  return glm::vec3(1.0f, -st.y, -st.x);
+		case 1:  return glm::vec3(-1.0f, -st.y, st.x);
+		case 2:  return glm::vec3(st.x, 1.0f, st.y);
+		case 3:  return glm::vec3(st.x, -1.0f, -st.y);
+		case 4:  return glm::vec3(st.x, -st.y, 1.0f);
+		default: return glm::vec3(-st.x, -st.y, -1.0f);
+		}
+	}
+
+	// Nearest texel of a level in direction `d`, the inverse of CubeDirection.
+	static const glm::vec4& Fetch(const CpuLevel& level, const glm::vec3& d)
+	{
+		glm::vec3 a = glm::abs(d);
+		int face;
+		float s, t, major;
+		if (a.x >= a.y && a.x >= a.z)
+		{
+			face = d.x > 0.0f ? 0 : 1;
+			major = a.x;
+			s = d.x > 0.0f ? -d.z : d.z;
+			t = -d.y;
+		}
+		else if (a.y >= a.z)
+		{
+			face = d.y > 0.0f ? 2 : 3;
+			major = a.y;
+			s = d.x;
+			t = d.y > 0.0f ? d.z : -d.z;
+		}
+		else
+		{
+			face = d.z > 0.0f ? 4 : 5;
+			major = a.z;
+			s = d.z > 0.0f ? d.x : -d.x;
+			t = -d.y;
+		}
+		int x = std::clamp(static_cast<int>((s / major * 0.5f + 0.5f) * level.size), 0, level.size - 1);
+		int y = std::clamp(static_cast<int>((t / major * 0.5f + 0.5f) * level.size), 0, level.size - 1);
+		return level.texels[(static_cast<size_t>(face) * level.size + y) * level.size + x];
+	}
+
+	// Reads the source back from the level no larger than `size` downwards.
+	static std::vector<CpuLevel> ReadBack(GLuint source, int size)
+	{
+		std::vector<CpuLevel> levels;
+		GLint width = 0;
+		glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_WIDTH, &width);
+		for (GLint level = FindLevel(source, size); level < GetLevelCount(source); ++level)
+		{
+			CpuLevel cpu;
+			cpu.size = std::max(1, width >> level);
+			cpu.texels.resize(static_cast<size_t>(cpu.size) * cpu.size * 6);
+			glGetTextureImage(source, level, GL_RGBA, GL_FLOAT, static_cast<GLsizei>(cpu.texels.size() * sizeof(glm::vec4)), cpu.texels.data());
+			levels.push_back(std::move(cpu));
+		}
+		return levels;
+	}
+
+	// Order 2 SH projection of one level, weighted by texel solid angle. The nine basis products
+	// are accumulated four channels at a time.
+	static IrradianceUBO ProjectOnCpu(const CpuLevel& level)
+	{
+		// Cosine lobe band factors divided by pi.
+		static const float bands[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+#if defined(__SSE2__) || defined(_M_X64)
+		__m128 sums[9];
+		for (__m128& sum : sums)
+			sum = _mm_setzero_ps();
+#else
+		glm::vec4 sums[9] = {};
+#endif
+		float totalWeight = 0.0f;
+		for (int face = 0; face < 6; ++face)
+		{
+			for (int y = 0; y < level.size; ++y)
+			{
+				for (int x = 0; x < level.size; ++x)
+				{
+					glm::vec2 st = (glm::vec2(x, y) + 0.5f) / static_cast<float>(level.size) * 2.0f - 1.0f;
+					glm::vec3 direction = CubeDirection(face, st);
+					float lengthSquared = glm::dot(direction, direction);
+					float weight = 4.0f / (std::sqrt(lengthSquared) * lengthSquared);
+					glm::vec3 n = direction / std::sqrt(lengthSquared);
+					totalWeight += weight;
+
+					const float basis[9] = {
+						0.282095f,
+						0.488603f * n.y,
+						0.488603f * n.z,
+						0.488603f * n.x,
+						1.092548f * n.x * n.y,
+						1.092548f * n.y * n.z,
+						0.315392f * (3.0f * n.z * n.z - 1.0f),
+						1.092548f * n.x * n.z,
+						0.546274f * (n.x * n.x - n.y * n.y)
+					};
+					const glm::vec4& texel = level.texels[(static_cast<size_t>(face) * level.size + y) * level.size + x];
+#if defined(__SSE2__) || defined(_M_X64)
+					__m128 radiance = _mm_mul_ps(_mm_loadu_ps(&texel.x), _mm_set1_ps(weight));
+					for (int i = 0; i < 9; ++i)
+						sums[i] = _mm_add_ps(sums[i], _mm_mul_ps(radiance, _mm_set1_ps(basis[i])));
+#else
+					for (int i = 0; i < 9; ++i)
+						sums[i] += texel * (weight * basis[i]);
+#endif
+				}
+			}
+		}
+
+		IrradianceUBO coefficients;
+		float solidAngleScale = 4.0f * glm::pi<float>() / totalWeight;
+		for (int i = 0; i < 9; ++i)
+		{
+#if defined(__SSE2__) || defined(_M_X64)
+			_mm_storeu_ps(&coefficients.SH[i].x, sums[i]);
+#else
+			coefficients.SH[i] = sums[i];
+#endif
+			coefficients.SH[i] = glm::vec4(glm::vec3(coefficients.SH[i]) * solidAngleScale * bands[i], 0.0f);
+		}
+		return coefficients;
+	}
+
+	// CPU version of ibl_prefilter.comp at a lower resolution, with nearest sampling of the mip
+	// chosen by each sample's footprint. Rows of every face are filtered as jobs, next to the SH
+	// projection.
+	static GLuint PrefilterOnCpu(GLuint source, IrradianceUBO& coefficients)
+	{
+		std::vector<CpuLevel> levels = ReadBack(source, std::max(s_CpuSpecularSize * 2, s_IrradianceSize));
+		if (levels.empty())
+			return 0;
+
+		auto irradiance = levels.begin();
+		while (irradiance->size > s_IrradianceSize && irradiance + 1 != levels.end())
+			++irradiance;
+		JobSystem& jobs = JobSystem::Get();
+		JobSystem::Fence projection = jobs.Run([&coefficients, irradiance]() { coefficients = ProjectOnCpu(*irradiance); });
+
+		GLuint textureID;
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+		glTextureStorage2D(textureID, s_CpuSpecularLevels, GL_RGBA16F, s_CpuSpecularSize, s_CpuSpecularSize);
+
+		const float texelSolidAngle = 4.0f * glm::pi<float>() / (6.0f * levels[0].size * levels[0].size);
+		std::vector<glm::vec4> output;
+		for (int level = 0; level < s_CpuSpecularLevels; ++level)
+		{
+			const int size = s_CpuSpecularSize >> level;
+			const float alpha = std::pow(static_cast<float>(level) / (s_CpuSpecularLevels - 1), 2.0f);
+			output.assign(static_cast<size_t>(size) * size * 6, glm::vec4(0.0f));
+
+			jobs.Wait(jobs.ParallelFor(static_cast<size_t>(size) * 6, std::max(1, size / 8), [&, size, alpha](size_t begin, size_t end)
+			{
+				for (size_t row = begin; row < end; ++row)
+				{
+					const int face = static_cast<int>(row / size), y = static_cast<int>(row % size);
+					for (int x = 0; x < size; ++x)
+					{
+						glm::vec2 st = (glm::vec2(x, y) + 0.5f) / static_cast<float>(size) * 2.0f - 1.0f;
+						glm::vec3 N = glm::normalize(CubeDirection(face, st));
+						glm::vec3 up = std::abs(N.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+						glm::vec3 tangent = glm::normalize(glm::cross(up, N));
+						glm::vec3 bitangent = glm::cross(N, tangent);
+
+						glm::vec3 color(0.0f);
+						float weight = 0.0f;
+						for (uint32_t i = 0; i < s_CpuSampleCount; ++i)
+						{
+							// Hammersley point, GGX half vector, reflected light direction.
+							uint32_t bits = i;
+							bits = (bits << 16) | (bits >> 16);
+							bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+							bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+							bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+							bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+							float phi = 2.0f * glm::pi<float>() * i / s_CpuSampleCount;
+							float xi = bits * 2.3283064365386963e-10f;
+							float cosTheta = std::sqrt((1.0f - xi) / (1.0f + (alpha * alpha - 1.0f) * xi));
+							float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+							glm::vec3 H = tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + N * cosTheta;
+							glm::vec3 L = 2.0f * glm::dot(N, H) * H - N;
+							float NoL = glm::dot(N, L);
+							if (NoL <= 0.0f)
+								continue;
+
+							float d = cosTheta * cosTheta * (alpha * alpha - 1.0f) + 1.0f;
+							float pdf = alpha * alpha / (glm::pi<float>() * d * d) / 4.0f + 1e-4f;
+							float lod = alpha == 0.0f ? 0.0f : 0.5f * std::log2(1.0f / (s_CpuSampleCount * pdf * texelSolidAngle)) + 1.0f;
+							size_t mip = static_cast<size_t>(std::clamp(lod + 0.5f, 0.0f, static_cast<float>(levels.size() - 1)));
+
+							color += glm::vec3(Fetch(levels[mip], L)) * NoL;
+							weight += NoL;
+						}
+						output[(static_cast<size_t>(face) * size + y) * size + x] = glm::vec4(color / std::max(weight, 1e-4f), 1.0f);
+					}
+				}
+			}));
+			glTextureSubImage3D(textureID, level, 0, 0, 0, size, size, 6, GL_RGBA, GL_FLOAT, output.data());
+		}
+
+		jobs.Wait(projection);
+		return textureID;
+	}
+};
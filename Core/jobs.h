@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system for CPU work outside of GL.
+//
+// Every thread has a deque: it pushes and pops its own jobs at the back, idle threads steal the
+// oldest job from the front of another. The thread that created the system is slot 0 and has no
+// worker of its own; it runs jobs while it waits on a Fence, so a system of one thread runs
+// everything inline on the caller. Jobs may submit and wait on further jobs the same way.
+//
+// A job can depend on fences and is only queued once they are all signaled. Jobs must not make
+// GL calls, only the main thread has a context.
+class JobSystem
+{
+	struct Task;
+
+	struct FenceState
+	{
+		std::atomic<size_t> pending = 0;
+		std::atomic<bool> done = false;
+		std::mutex mutex;
+		std::vector<std::shared_ptr<Task>> dependents;
+	};
+
+	struct Task
+	{
+		std::function<void()> work;
+		std::shared_ptr<FenceState> fence;
+		std::atomic<size_t> waiting = 0;
+	};
+
+public:
+	// Signaled once every job it was returned for has finished. A default Fence is signaled.
+	class Fence
+	{
+	public:
+		bool IsDone() const
+		{
+			return !m_State || m_State->done;
+		}
+
+	private:
+		friend class JobSystem;
+		std::shared_ptr<FenceState> m_State;
+	};
+
+	// `threads` counts the calling thread, so threads - 1 workers are started.
+	explicit JobSystem(unsigned threads = std::thread::hardware_concurrency()) : m_Previous(s_Current)
+	{
+		threads = std::max(threads, 1u);
+		for (unsigned i = 0; i < threads; ++i)
+			m_Queues.push_back(std::make_unique<Queue>());
+		for (unsigned i = 1; i < threads; ++i)
+			m_Workers.emplace_back([this, i]() { Work(i); });
+		s_Current = this;
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			m_Stopping = true;
+		}
+		m_Wake.notify_all();
+		for (std::thread& worker : m_Workers)
+			worker.join();
+		s_Current = m_Previous;
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// The most recently created system that is still alive.
+	static JobSystem& Get()
+	{
+		return *s_Current;
+	}
+
+	unsigned GetThreadCount() const
+	{
+		return static_cast<unsigned>(m_Queues.size());
+	}
+
+	Fence Run(std::function<void()> job, std::initializer_list<Fence> dependencies = {})
+	{
+		Fence fence = CreateFence(1);
+		Submit(std::move(job), fence, dependencies);
+		return fence;
+	}
+
+	// Calls body(begin, end) over [0, count) in chunks of `grain` items.
+	Fence ParallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> body, std::initializer_list<Fence> dependencies = {})
+	{
+		grain = std::max<size_t>(grain, 1);
+		const size_t chunks = (count + grain - 1) / grain;
+		Fence fence = CreateFence(chunks);
+		if (chunks == 0)
+			fence.m_State->done = true;
+
+		std::shared_ptr<std::function<void(size_t, size_t)>> shared = std::make_shared<std::function<void(size_t, size_t)>>(std::move(body));
+		for (size_t chunk = 0; chunk < chunks; ++chunk)
+		{
+			size_t begin = chunk * grain, end = std::min(count, begin + grain);
+			Submit([shared, begin, end]() { (*shared)(begin, end); }, fence, dependencies);
+		}
+		return fence;
+	}
+
+	// Runs queued jobs until `fence` is signaled.
+	void Wait(const Fence& fence)
+	{
+		const size_t slot = GetSlot();
+		while (!fence.IsDone())
+		{
+			if (std::shared_ptr<Task> task = Take(slot))
+				Execute(task);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	// Calls `body` under a fresh system of every thread count from 1 to `maxThreads` and returns
+	// the milliseconds of each, fastest of `repeats`. Get() is the temporary system meanwhile.
+	static std::vector<double> MeasureScaling(unsigned maxThreads, int repeats, const std::function<void()>& body)
+	{
+		std::vector<double> milliseconds;
+		for (unsigned threads = 1; threads <= maxThreads; ++threads)
+		{
+			JobSystem system(threads);
+			double best = 0.0;
+			for (int i = 0; i < repeats; ++i)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				body();
+				double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				best = i == 0 ? elapsed : std::min(best, elapsed);
+			}
+			milliseconds.push_back(best);
+		}
+		return milliseconds;
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::shared_ptr<Task>> tasks;
+	};
+
+	inline static JobSystem* s_Current = nullptr;
+	inline static thread_local const JobSystem* s_Owner = nullptr;
+	inline static thread_local size_t s_Slot = 0;
+
+	JobSystem* m_Previous;
+	std::vector<std::unique_ptr<Queue>> m_Queues;
+	std::vector<std::thread> m_Workers;
+	std::atomic<size_t> m_Queued = 0;
+	std::mutex m_SleepMutex;
+	std::condition_variable m_Wake;
+	bool m_Stopping = false;
+
+	// Workers use their own deque, any other thread shares slot 0.
+	size_t GetSlot() const
+	{
+		return s_Owner == this ? s_Slot : 0;
+	}
+
+	static Fence CreateFence(size_t jobs)
+	{
+		Fence fence;
+		fence.m_State = std::make_shared<FenceState>();
+		fence.m_State->pending = jobs;
+		return fence;
+	}
+
+	// Queues the task once its dependencies are signaled. The extra count held while registering
+	// keeps a dependency that finishes meanwhile from queuing it early.
+	void Submit(std::function<void()> work, const Fence& fence, std::initializer_list<Fence> dependencies)
+	{
+		std::shared_ptr<Task> task = std::make_shared<Task>();
+		task->work = std::move(work);
+		task->fence = fence.m_State;
+		task->waiting = dependencies.size() + 1;
+		for (const Fence& dependency : dependencies)
+		{
+			bool done = true;
+			if (dependency.m_State)
+			{
+				std::lock_guard<std::mutex> lock(dependency.m_State->mutex);
+				done = dependency.m_State->done;
+				if (!done)
+					dependency.m_State->dependents.push_back(task);
+			}
+			if (done)
+				--task->waiting;
+		}
+		Release(task);
+	}
+
+	void Release(const std::shared_ptr<Task>& task)
+	{
+		if (task->waiting.fetch_sub(1) != 1)
+			return;
+
+		Queue& queue = *m_Queues[GetSlot()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(task);
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+			++m_Queued;
+		}
+		m_Wake.notify_one();
+	}
+
+	// The newest job of `slot`, otherwise the oldest job of another thread.
+	std::shared_ptr<Task> Take(size_t slot)
+	{
+		std::shared_ptr<Task> task;
+		for (size_t i = 0; i < m_Queues.size() && !task; ++i)
+		{
+			Queue& queue = *m_Queues[(slot + i) % m_Queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+			if (i == 0)
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+		}
+		if (task)
+			--m_Queued;
+		return task;
+	}
+
+	void Execute(const std::shared_ptr<Task>& task)
+	{
+		task->work();
+		task->work = nullptr;
+
+		FenceState& fence = *task->fence;
+		if (fence.pending.fetch_sub(1) != 1)
+			return;
+
+		std::vector<std::shared_ptr<Task>> dependents;
+		{
+			std::lock_guard<std::mutex> lock(fence.mutex);
+			fence.done = true;
+			dependents.swap(fence.dependents);
+		}
+		for (const std::shared_ptr<Task>& dependent : dependents)
+			Release(dependent);
+	}
+
+	void Work(size_t slot)
+	{
+		s_Owner = this;
+		s_Slot = slot;
+		for (;;)
+		{
+			if (std::shared_ptr<Task> task = Take(slot))
+			{
+				Execute(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_SleepMutex);
+			m_Wake.wait(lock, [this]() { return m_Queued > 0 || m_Stopping; });
+			if (m_Stopping && m_Queued == 0)
+				return;
+		}
+	}
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Clustered light culling.
+//
+// The view frustum is split into s_TilesX x s_TilesY screen tiles and s_Slices depth slices,
+// spaced exponentially between the camera near plane and s_ClusterFar; the last slice reaches to
+// the camera far plane. light_cull.comp tests every light's bounding sphere against every
+// cluster's view space AABB and writes a compact index list, so shaders only loop over the
+// lights of the cluster a fragment falls in. Spot lights are culled by their bounding sphere.
+//
+// Bindings: cluster UBO 3, SSBO 7 lights, 8 cluster (offset, count) pairs, 9 light indices,
+// 10 allocation counter.
+class ClusteredLights
+{
+public:
+	static constexpr uint32_t s_TilesX = 16;
+	static constexpr uint32_t s_TilesY = 9;
+	static constexpr uint32_t s_Slices = 24;
+	static constexpr uint32_t s_ClusterCount = s_TilesX * s_TilesY * s_Slices;
+	static constexpr uint32_t s_MaxLights = 256;
+	static constexpr uint32_t s_MaxLightsPerCluster = 64;
+	// Index list capacity, clusters past it are left empty.
+	static constexpr uint32_t s_MaxIndices = s_ClusterCount * 32;
+	static constexpr float s_ClusterFar = 100.0f;
+
+	enum Type : uint32_t
+	{
+		Point = 0,
+		Spot = 1,
+	};
+
+	// std430 layout shared with light_cull.comp and the lighting shaders.
+	struct PunctualLight
+	{
+		glm::vec3 position = glm::vec3(0.0f);
+		float range = 1.0f;
+		glm::vec3 color = glm::vec3(1.0f);
+		uint32_t type = Point;
+		glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		float cosOuter = 0.0f;
+		float cosInner = 0.0f;
+		float padding[3] = {};
+	};
+
+	struct ClusterUBO
+	{
+		glm::mat4 View;
+		glm::mat4 InverseProjection;
+		glm::uvec4 Grid;   // tiles x, tiles y, slices, light count
+		glm::vec4 Depth;   // near, slicing far, log scale, log bias
+		glm::vec4 Params;  // tile width, tile height, camera far
+	};
+
+	ClusteredLights()
+	{
+		glCreateBuffers(1, &m_UBO);
+		glNamedBufferStorage(m_UBO, sizeof(ClusterUBO), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(4, m_Buffers);
+		glNamedBufferStorage(m_Buffers[0], sizeof(PunctualLight) * s_MaxLights, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glNamedBufferStorage(m_Buffers[1], sizeof(glm::uvec2) * s_ClusterCount, nullptr, GL_NONE);
+		glNamedBufferStorage(m_Buffers[2], sizeof(uint32_t) * s_MaxIndices, nullptr, GL_NONE);
+		glNamedBufferStorage(m_Buffers[3], sizeof(uint32_t), nullptr, GL_NONE);
+	}
+
+	~ClusteredLights()
+	{
+		glDeleteBuffers(1, &m_UBO);
+		glDeleteBuffers(4, m_Buffers);
+	}
+
+	void SetLights(const std::vector<PunctualLight>& lights)
+	{
+		m_Lights.assign(lights.begin(), lights.begin() + std::min<size_t>(lights.size(), s_MaxLights));
+		if (!m_Lights.empty())
+			glNamedBufferSubData(m_Buffers[0], 0, sizeof(PunctualLight) * m_Lights.size(), m_Lights.data());
+	}
+
+	const std::vector<PunctualLight>& GetLights() const
+	{
+		return m_Lights;
+	}
+
+	// Rebuilds the cluster parameters from the camera, call once per frame before culling.
+	void Update(Camera& camera, int width, int height)
+	{
+		float logRange = std::log(s_ClusterFar / camera.GetNear());
+		m_Cluster.View = camera.GetViewMatrix();
+		m_Cluster.InverseProjection = glm::inverse(camera.GetProjectionMatrix());
+		m_Cluster.Grid = glm::uvec4(s_TilesX, s_TilesY, s_Slices, static_cast<uint32_t>(m_Lights.size()));
+		m_Cluster.Depth = glm::vec4(camera.GetNear(), s_ClusterFar, s_Slices / logRange, -s_Slices * std::log(camera.GetNear()) / logRange);
+		m_Cluster.Params = glm::vec4(static_cast<float>(width) / s_TilesX, static_cast<float>(height) / s_TilesY, camera.GetFar(), 0.0f);
+		glNamedBufferSubData(m_UBO, 0, sizeof(ClusterUBO), &m_Cluster);
+	}
+
+	void Bind() const
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, 3, m_UBO);
+		glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 7, 4, m_Buffers);
+	}
+
+	// Runs light_cull.comp, which must be the current program.
+	void Cull() const
+	{
+		const uint32_t zero = 0;
+		glClearNamedBufferData(m_Buffers[3], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		Bind();
+		glDispatchCompute((s_ClusterCount + 63) / 64, 1, 1);
+	}
+
+	GLuint GetClusterBuffer() const
+	{
+		return m_Buffers[1];
+	}
+
+	GLuint GetIndexBuffer() const
+	{
+		return m_Buffers[2];
+	}
+
+	// View space bounds of a cluster, the same math as light_cull.comp.
+	void GetClusterBounds(uint32_t cluster, glm::vec3& minimum, glm::vec3& maximum) const
+	{
+		uint32_t x = cluster % s_TilesX;
+		uint32_t y = (cluster / s_TilesX) % s_TilesY;
+		uint32_t slice = cluster / (s_TilesX * s_TilesY);
+
+		float nearDepth = SliceDepth(slice);
+		float farDepth = slice + 1 == s_Slices ? m_Cluster.Params.z : SliceDepth(slice + 1);
+
+		minimum = glm::vec3(std::numeric_limits<float>::max());
+		maximum = -minimum;
+		for (uint32_t corner = 0; corner < 4; ++corner)
+		{
+			glm::vec2 ndc = glm::vec2(x + (corner & 1), y + (corner >> 1)) / glm::vec2(s_TilesX, s_TilesY) * 2.0f - 1.0f;
+			glm::vec4 onNear = m_Cluster.InverseProjection * glm::vec4(ndc, 0.0f, 1.0f);
+			glm::vec3 ray = glm::vec3(onNear) / onNear.w;
+			for (float depth : { nearDepth, farDepth })
+			{
+				glm::vec3 point = ray * (depth / -ray.z);
+				minimum = glm::min(minimum, point);
+				maximum = glm::max(maximum, point);
+			}
+		}
+	}
+
+	// CPU reference binner: the light indices of every cluster, in light order.
+	std::vector<std::vector<uint32_t>> BinOnCpu() const
+	{
+		std::vector<std::vector<uint32_t>> clusters(s_ClusterCount);
+		for (uint32_t cluster = 0; cluster < s_ClusterCount; ++cluster)
+		{
+			glm::vec3 minimum, maximum;
+			GetClusterBounds(cluster, minimum, maximum);
+			for (uint32_t i = 0; i < m_Lights.size() && clusters[cluster].size() < s_MaxLightsPerCluster; ++i)
+			{
+				glm::vec3 center = glm::vec3(m_Cluster.View * glm::vec4(m_Lights[i].position, 1.0f));
+				glm::vec3 closest = glm::clamp(center, minimum, maximum);
+				if (glm::dot(closest - center, closest - center) <= m_Lights[i].range * m_Lights[i].range)
+					clusters[cluster].push_back(i);
+			}
+		}
+		return clusters;
+	}
+
+	// Reads the GPU lists back (stalls) and compares them with BinOnCpu. Lights sitting exactly on
+	// a cluster boundary may legitimately differ by rounding, so this reports rather than asserts.
+	uint32_t Validate() const
+	{
+		std::vector<glm::uvec2> ranges(s_ClusterCount);
+		std::vector<uint32_t> indices(s_MaxIndices);
+		glGetNamedBufferSubData(m_Buffers[1], 0, sizeof(glm::uvec2) * ranges.size(), ranges.data());
+		glGetNamedBufferSubData(m_Buffers[2], 0, sizeof(uint32_t) * indices.size(), indices.data());
+
+		std::vector<std::vector<uint32_t>> reference = BinOnCpu();
+		uint32_t mismatches = 0;
+		for (uint32_t cluster = 0; cluster < s_ClusterCount; ++cluster)
+		{
+			if (ranges[cluster].x + ranges[cluster].y > indices.size())
+			{
+				++mismatches;
+				continue;
+			}
+			std::vector<uint32_t> gpu(indices.begin() + ranges[cluster].x, indices.begin() + ranges[cluster].x + ranges[cluster].y);
+			if (gpu != reference[cluster])
+				++mismatches;
+		}
+
+		if (mismatches)
+			LOG_RUNTIME_WARN("Light clusters: {} of {} differ from the CPU reference.", mismatches, s_ClusterCount);
+		else
+			LOG_RUNTIME_INFO("Light clusters match the CPU reference ({} lights).", m_Lights.size());
+		return mismatches;
+	}
+
+private:
+	std::vector<PunctualLight> m_Lights;
+	ClusterUBO m_Cluster = {};
+	GLuint m_UBO = 0;
+	GLuint m_Buffers[4] = {};
+
+	float SliceDepth(uint32_t slice) const
+	{
+		return m_Cluster.Depth.x * std::pow(m_Cluster.Depth.y / m_Cluster.Depth.x, static_cast<float>(slice) / s_Slices);
+	}
+};
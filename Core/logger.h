@@ -1,45 +1,355 @@
 #pragma once
 
+// Trace and debug messages are compiled out of Release builds, see the LOG_* macros below.
+#if !defined(SPDLOG_ACTIVE_LEVEL)
+#if defined(NDEBUG)
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#else
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <spdlog/spdlog.h>
+#include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+// Hands messages to a background thread that writes them to the real sinks.
+//
+// Argument formatting stays on the calling thread: spdlog formats the message text into its
+// stack buffer before any sink sees it, and the arguments are often temporaries such as
+// path.string() that cannot outlive the call. What moves to the worker is everything after
+// that: the pattern with its time stamp, colors, and the console and file writes.
+//
+// The caller copies the text into a bounded lock-free ring (Vyukov's queue with a single
+// consumer), with no lock, no I/O and no heap. A message longer than one slot takes consecutive
+// slots, up to s_MaxSlots, and is cut beyond that. When the ring is full a message below error
+// level is dropped rather than waited for, and the worker reports how many were lost. The
+// worker sleeps on a condition variable while the ring is empty; a producer only takes the
+// mutex to wake it when it is asleep.
+class AsyncLogSink : public spdlog::sinks::sink
+{
+public:
+	static constexpr size_t s_Capacity = 2048;  // Slots, a power of two.
+	static constexpr size_t s_SlotText = 256;
+	static constexpr size_t s_MaxSlots = 64;    // Per message, so at most 16 KiB of text.
+
+	explicit AsyncLogSink(std::vector<spdlog::sink_ptr> sinks) : m_Sinks(std::move(sinks)), m_Slots(std::make_unique<Slot[]>(s_Capacity))
+	{
+		for (size_t i = 0; i < s_Capacity; ++i)
+			m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+		m_Worker = std::thread([this]() { Run(); });
+	}
+
+	// Writes everything still queued.
+	~AsyncLogSink()
+	{
+		m_Running = false;
+		Wake();
+		m_Worker.join();
+	}
+
+	void log(const spdlog::details::log_msg& msg) override
+	{
+		const size_t length = std::min(msg.payload.size(), s_MaxSlots * s_SlotText);
+		const size_t count = std::max<size_t>(1, (length + s_SlotText - 1) / s_SlotText);
+
+		// Slots are freed in order, so once the last slot of the claim is free all of them are.
+		size_t position = m_Tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			const size_t last = position + count - 1;
+			size_t sequence = m_Slots[last & (s_Capacity - 1)].sequence.load(std::memory_order_acquire);
+			if (sequence == last)
+			{
+				if (m_Tail.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+					break;
+			}
+			else if (sequence < last)
+			{
+				// Full. Errors wait for the worker, anything else is dropped.
+				if (msg.level < spdlog::level::err)
+				{
+					m_Dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				std::this_thread::yield();
+				position = m_Tail.load(std::memory_order_relaxed);
+			}
+			else
+			{
+				position = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		Slot& first = m_Slots[position & (s_Capacity - 1)];
+		first.time = msg.time;
+		first.threadId = msg.thread_id;
+		first.source = msg.source;
+		first.level = msg.level;
+		size_t nameLength = std::min(msg.logger_name.size(), sizeof(first.name) - 1);
+		memcpy(first.name, msg.logger_name.data(), nameLength);
+		first.name[nameLength] = '\0';
+		first.length = length;
+		first.count = count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t offset = i * s_SlotText;
+			memcpy(m_Slots[(position + i) & (s_Capacity - 1)].text, msg.payload.data() + offset, std::min(s_SlotText, length - offset));
+		}
+
+		// The first slot goes last, the worker reads the whole message once it sees that one.
+		for (size_t i = count - 1; i > 0; --i)
+			m_Slots[(position + i) & (s_Capacity - 1)].sequence.store(position + i + 1, std::memory_order_release);
+		first.sequence.store(position + 1, std::memory_order_release);
+
+		// Pairs with the fence in Run(): either the worker sees the message or this sees it asleep.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_Sleeping.load(std::memory_order_relaxed))
+			Wake();
+	}
+
+	// Asks the worker to flush once it has written what is queued; does not wait.
+	void flush() override
+	{
+		m_FlushRequests.fetch_add(1);
+		Wake();
+	}
+
+	void set_pattern(const std::string& pattern) override
+	{
+		for (const spdlog::sink_ptr& sink : m_Sinks)
+			sink->set_pattern(pattern);
+	}
+
+	void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override
+	{
+		for (const spdlog::sink_ptr& sink : m_Sinks)
+			sink->set_formatter(formatter->clone());
+	}
+
+	// Blocks until every message logged so far is written and flushed.
+	void Drain()
+	{
+		const size_t tail = m_Tail.load(std::memory_order_acquire);
+		const size_t request = m_FlushRequests.fetch_add(1) + 1;
+		Wake();
+		while (m_Written.load(std::memory_order_acquire) < tail || m_Flushed.load(std::memory_order_acquire) < request)
+			std::this_thread::yield();
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		// Set in the first slot of a message only.
+		spdlog::log_clock::time_point time;
+		size_t threadId = 0;
+		spdlog::source_loc source;
+		spdlog::level::level_enum level = spdlog::level::info;
+		char name[16] = {};
+		size_t length = 0;  // Text bytes over all of the message's slots.
+		size_t count = 1;   // Slots of the message.
+
+		char text[s_SlotText];
+	};
+
+	std::vector<spdlog::sink_ptr> m_Sinks;
+	std::unique_ptr<Slot[]> m_Slots;
+	alignas(64) std::atomic<size_t> m_Tail = 0;
+	alignas(64) std::atomic<size_t> m_Written = 0;
+	std::atomic<size_t> m_Dropped = 0;
+	std::atomic<size_t> m_FlushRequests = 0;
+	std::atomic<size_t> m_Flushed = 0;
+	std::atomic<bool> m_Running = true;
+	std::atomic<bool> m_Sleeping = false;
+	std::mutex m_WakeMutex;
+	std::condition_variable m_Wake;
+	std::string m_Text;  // Worker only: a message spanning several slots, put back together.
+	std::thread m_Worker;
+
+	// Taking the mutex orders the notification after a worker that is about to wait.
+	void Wake()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_WakeMutex);
+		}
+		m_Wake.notify_one();
+	}
+
+	bool IsReady(size_t head) const
+	{
+		return m_Slots[head & (s_Capacity - 1)].sequence.load(std::memory_order_acquire) == head + 1;
+	}
+
+	void Run()
+	{
+		size_t head = 0;
+		for (;;)
+		{
+			// Read before draining, so nothing logged before a stop or flush request is left behind.
+			bool running = m_Running;
+			size_t flushRequests = m_FlushRequests;
+			bool flush = flushRequests != m_Flushed;
+			while (IsReady(head))
+			{
+				const Slot& first = m_Slots[head & (s_Capacity - 1)];
+				const size_t count = first.count;
+				spdlog::string_view_t text(first.text, first.length);
+				if (count > 1)
+				{
+					m_Text.clear();
+					for (size_t i = 0; i < count; ++i)
+						m_Text.append(m_Slots[(head + i) & (s_Capacity - 1)].text, std::min(s_SlotText, first.length - i * s_SlotText));
+					text = m_Text;
+				}
+				spdlog::details::log_msg msg(first.time, first.source, first.name, first.level, text);
+				msg.thread_id = first.threadId;
+				Write(msg);
+				flush |= first.level >= spdlog::level::err;
+
+				for (size_t i = 0; i < count; ++i)
+					m_Slots[(head + i) & (s_Capacity - 1)].sequence.store(head + i + s_Capacity, std::memory_order_release);
+				head += count;
+				m_Written.store(head, std::memory_order_release);
+			}
+
+			if (size_t dropped = m_Dropped.exchange(0))
+			{
+				std::string text = std::to_string(dropped) + " log messages dropped, the queue was full.";
+				Write(spdlog::details::log_msg("Logger", spdlog::level::warn, text));
+			}
+
+			if (flush)
+			{
+				for (const spdlog::sink_ptr& sink : m_Sinks)
+					sink->flush();
+				m_Flushed.store(flushRequests, std::memory_order_release);
+			}
+
+			if (!running)
+				return;
+
+			m_Sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			{
+				std::unique_lock<std::mutex> lock(m_WakeMutex);
+				m_Wake.wait(lock, [&]() { return IsReady(head) || !m_Running || m_FlushRequests != m_Flushed; });
+			}
+			m_Sleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void Write(const spdlog::details::log_msg& msg)
+	{
+		for (const spdlog::sink_ptr& sink : m_Sinks)
+			if (sink->should_log(msg.level))
+				sink->log(msg);
+	}
+};
+
 class Logger
 {
 public:
 	static void Init();
 
+	// Sends both loggers to the console and, unless `file` is empty, to that file. With `async`
+	// the writes move to an AsyncLogSink thread. With `useStderr` the console output goes there
+	// instead of stdout, keeping stdout for machine-readable results.
+	static void Configure(bool async, const std::filesystem::path& file, bool useStderr = false);
+
+	// Writes out everything queued, e.g. before exiting.
+	static void Flush();
+
 	inline static const std::shared_ptr<spdlog::logger>& OpenGL() { return s_OpenGLLogger; };
 	inline static const std::shared_ptr<spdlog::logger>& Runtime() { return s_RuntimeLogger; };
 private:
 	static std::shared_ptr<spdlog::logger> s_OpenGLLogger;
 	static std::shared_ptr<spdlog::logger> s_RuntimeLogger;
+	static std::shared_ptr<AsyncLogSink> s_AsyncSink;
 
+	static constexpr const char* s_Pattern = "[%H:%M:%S.%e] [%n] %^[%l]%$ %v";
 };
 
+// Until Configure() runs, which is only after the command line is parsed, messages go to
+// stderr, so argument warnings never mix with results on stdout.
 void Logger::Init()
 {
-	spdlog::set_pattern("[%H:%M:%S.%e] [%n] %^[%l]%$ %v");
-	s_OpenGLLogger = spdlog::stdout_color_mt("OpenGL");
+	spdlog::set_pattern(s_Pattern);
+	s_OpenGLLogger = spdlog::stderr_color_mt("OpenGL");
 	s_OpenGLLogger->set_level(spdlog::level::trace);
 
-	s_RuntimeLogger = spdlog::stdout_color_mt("Runtime");
+	s_RuntimeLogger = spdlog::stderr_color_mt("Runtime");
 	s_RuntimeLogger->set_level(spdlog::level::trace);
 }
 
+void Logger::Configure(bool async, const std::filesystem::path& file, bool useStderr)
+{
+	Flush();
+
+	std::vector<spdlog::sink_ptr> sinks;
+	if (useStderr)
+		sinks.push_back(std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
+	else
+		sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+	if (!file.empty())
+	{
+		try
+		{
+			sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(file.string(), true));
+		}
+		catch (const spdlog::spdlog_ex& error)
+		{
+			s_RuntimeLogger->error("Cannot open log file {}: {}", file.string(), error.what());
+		}
+	}
+	for (const spdlog::sink_ptr& sink : sinks)
+		sink->set_pattern(s_Pattern);
+
+	std::shared_ptr<AsyncLogSink> asyncSink = async ? std::make_shared<AsyncLogSink>(sinks) : nullptr;
+	for (const std::shared_ptr<spdlog::logger>& logger : { s_OpenGLLogger, s_RuntimeLogger })
+	{
+		if (asyncSink)
+			logger->sinks() = { asyncSink };
+		else
+			logger->sinks() = sinks;
+	}
+	s_AsyncSink = asyncSink;
+
+	s_RuntimeLogger->info("Logging {}{}{}.", async ? "asynchronously" : "synchronously", file.empty() ? "" : " to ", file.string());
+}
+
+void Logger::Flush()
+{
+	if (s_AsyncSink)
+		s_AsyncSink->Drain();
+	for (const std::shared_ptr<spdlog::logger>& logger : { s_OpenGLLogger, s_RuntimeLogger })
+		logger->flush();
+}
+
 std::shared_ptr<spdlog::logger> Logger::s_OpenGLLogger;
 std::shared_ptr<spdlog::logger> Logger::s_RuntimeLogger;
+std::shared_ptr<AsyncLogSink> Logger::s_AsyncSink;
+
+#define LOG_OPENGL_TRACE(...)    SPDLOG_LOGGER_TRACE(Logger::OpenGL(), __VA_ARGS__)
+#define LOG_OPENGL_DEBUG(...)    SPDLOG_LOGGER_DEBUG(Logger::OpenGL(), __VA_ARGS__)
+#define LOG_OPENGL_INFO(...)     SPDLOG_LOGGER_INFO(Logger::OpenGL(), __VA_ARGS__)
+#define LOG_OPENGL_WARN(...)     SPDLOG_LOGGER_WARN(Logger::OpenGL(), __VA_ARGS__)
+#define LOG_OPENGL_ERROR(...)    SPDLOG_LOGGER_ERROR(Logger::OpenGL(), __VA_ARGS__)
+#define LOG_OPENGL_CRITICAL(...) SPDLOG_LOGGER_CRITICAL(Logger::OpenGL(), __VA_ARGS__)
 
-#define LOG_OPENGL_TRACE(...)    Logger::OpenGL()->trace(__VA_ARGS__)
-#define LOG_OPENGL_DEBUG(...)    Logger::OpenGL()->debug(__VA_ARGS__)
-#define LOG_OPENGL_INFO(...)     Logger::OpenGL()->info(__VA_ARGS__)
-#define LOG_OPENGL_WARN(...)     Logger::OpenGL()->warn(__VA_ARGS__)
-#define LOG_OPENGL_ERROR(...)    Logger::OpenGL()->error(__VA_ARGS__)
-#define LOG_OPENGL_CRITICAL(...) Logger::OpenGL()->critical(__VA_ARGS__)
-
-#define LOG_RUNTIME_TRACE(...)    Logger::Runtime()->trace(__VA_ARGS__)
-#define LOG_RUNTIME_DEBUG(...)    Logger::Runtime()->debug(__VA_ARGS__)
-#define LOG_RUNTIME_INFO(...)     Logger::Runtime()->info(__VA_ARGS__)
-#define LOG_RUNTIME_WARN(...)     Logger::Runtime()->warn(__VA_ARGS__)
-#define LOG_RUNTIME_ERROR(...)    Logger::Runtime()->error(__VA_ARGS__)
-#define LOG_RUNTIME_CRITICAL(...) Logger::Runtime()->critical(__VA_ARGS__)
\ No newline at end of file
+#define LOG_RUNTIME_TRACE(...)    SPDLOG_LOGGER_TRACE(Logger::Runtime(), __VA_ARGS__)
+#define LOG_RUNTIME_DEBUG(...)    SPDLOG_LOGGER_DEBUG(Logger::Runtime(), __VA_ARGS__)
+#define LOG_RUNTIME_INFO(...)     SPDLOG_LOGGER_INFO(Logger::Runtime(), __VA_ARGS__)
+#define LOG_RUNTIME_WARN(...)     SPDLOG_LOGGER_WARN(Logger::Runtime(), __VA_ARGS__)
+#define LOG_RUNTIME_ERROR(...)    SPDLOG_LOGGER_ERROR(Logger::Runtime(), __VA_ARGS__)
+#define LOG_RUNTIME_CRITICAL(...) SPDLOG_LOGGER_CRITICAL(Logger::Runtime(), __VA_ARGS__)
@@ -6,14 +6,36 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <tiny_gltf.h>
 #include <cyCodeBase/cyHairFile.h>
+#include <numeric>
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl3.h>
 
 #include "logger.h"
+#include "arena.h"
+#include "jobs.h"
 #include "camera.h"
+#include "scene.h"
+#include "shaderpreprocessor.h"
+#include "embeddedfiles.h"
+#include "programcache.h"
 #include "shader.h"
+#include "shaderwatcher.h"
+#include "profiler.h"
+#include "shadow.h"
+#include "rendergraph.h"
+#include "options.h"
+#include "headless.h"
+#include "gldebug.h"
+#include "framewriter.h"
+#include "benchmark.h"
+#include "texturecache.h"
+#include "material.h"
+#include "mesh.h"
+#include "lights.h"
+#include "texture.h"
+#include "ibl.h"
 
 struct Light
 {
@@ -46,28 +68,154 @@ struct Meshlet
 	unsigned int index_count   = 0;
 };
 
+// Strands per job in the hair passes below.
+constexpr size_t s_StrandGrain = 4096;
+
+// One meshlet per strand. Jobs lay out their strands from 0, then shift by the points of the
+// strands before them once every job has counted its own.
 std::vector<Meshlet> BuildMeshlets(const cyHairFile& hairfile)
 {
-	std::vector<Meshlet> meshlets;
-	
-	int pointIndex = 0;
-	int hairCount = hairfile.GetHeader().hair_count;
+	const size_t hairCount = hairfile.GetHeader().hair_count;
 	const unsigned short* segments = hairfile.GetSegmentsArray();
-	for(size_t i = 0; i < hairCount; ++i)
+	std::vector<Meshlet> meshlets(hairCount);
+	std::vector<unsigned int> chunkPoints((hairCount + s_StrandGrain - 1) / s_StrandGrain + 1, 0);
+
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(hairCount, s_StrandGrain, [&](size_t begin, size_t end)
 	{
-		Meshlet meshlet;
-		meshlet.vertex_offset = pointIndex;
-		meshlet.vertex_count = segments[i] + 1;
-		//meshlet.index_offset = i;
-		//meshlet.index_count++;
-		meshlets.push_back(meshlet);
-		pointIndex += meshlet.vertex_count;
-	}
+		unsigned int pointIndex = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			meshlets[i].vertex_offset = pointIndex;
+			meshlets[i].vertex_count = segments[i] + 1;
+			pointIndex += meshlets[i].vertex_count;
+		}
+		chunkPoints[begin / s_StrandGrain + 1] = pointIndex;
+	}));
+	std::partial_sum(chunkPoints.begin(), chunkPoints.end(), chunkPoints.begin());
+	jobs.Wait(jobs.ParallelFor(hairCount, s_StrandGrain, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+			meshlets[i].vertex_offset += chunkPoints[begin / s_StrandGrain];
+	}));
+
+	return meshlets;
+}
+
+// Splits strands into chunks of at most s_RibbonChunkPoints points for hair_ribbon.mesh and
+// hair_coverage.mesh. Chunks overlap by one point so the strand stays connected; index_offset
+// and index_count hold the whole strand.
+constexpr unsigned int s_RibbonChunkPoints = 64;
+
+// Counted per job first, like BuildMeshlets(), so every job writes its chunks in place.
+std::vector<Meshlet> BuildRibbonMeshlets(const cyHairFile& hairfile)
+{
+	const size_t hairCount = hairfile.GetHeader().hair_count;
+	const unsigned short* segments = hairfile.GetSegmentsArray();
+	const size_t jobCount = (hairCount + s_StrandGrain - 1) / s_StrandGrain;
+	std::vector<unsigned int> jobPoints(jobCount + 1, 0), jobMeshlets(jobCount + 1, 0);
+
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(hairCount, s_StrandGrain, [&](size_t begin, size_t end)
+	{
+		unsigned int points = 0, chunks = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			unsigned int strandPoints = segments[i] + 1u;
+			points += strandPoints;
+			chunks += (strandPoints + s_RibbonChunkPoints - 3) / (s_RibbonChunkPoints - 1);
+		}
+		jobPoints[begin / s_StrandGrain + 1] = points;
+		jobMeshlets[begin / s_StrandGrain + 1] = chunks;
+	}));
+	std::partial_sum(jobPoints.begin(), jobPoints.end(), jobPoints.begin());
+	std::partial_sum(jobMeshlets.begin(), jobMeshlets.end(), jobMeshlets.begin());
+
+	std::vector<Meshlet> meshlets(jobMeshlets.back());
+	jobs.Wait(jobs.ParallelFor(hairCount, s_StrandGrain, [&](size_t begin, size_t end)
+	{
+		unsigned int pointIndex = jobPoints[begin / s_StrandGrain];
+		Meshlet* meshlet = meshlets.data() + jobMeshlets[begin / s_StrandGrain];
+		for (size_t i = begin; i < end; ++i)
+		{
+			unsigned int strandPoints = segments[i] + 1u;
+			for (unsigned int first = 0; first + 1 < strandPoints; first += s_RibbonChunkPoints - 1, ++meshlet)
+			{
+				meshlet->vertex_offset = pointIndex + first;
+				meshlet->vertex_count = std::min(s_RibbonChunkPoints, strandPoints - first);
+				meshlet->index_offset = pointIndex;
+				meshlet->index_count = strandPoints;
+			}
+			pointIndex += strandPoints;
+		}
+	}));
 
 	return meshlets;
 }
 
-void LoadHairModel(const char* filename, cyHairFile& hairfile, float*& dirs)
+// Bounding sphere of the hair points in model space (xyz: center, w: radius).
+glm::vec4 ComputeBoundingSphere(const cyHairFile& hairfile)
+{
+	int pointCount = hairfile.GetHeader().point_count;
+	const float* points = hairfile.GetPointsArray();
+	if (pointCount == 0 || points == nullptr)
+		return glm::vec4(0.0f);
+
+	// Bounds per job, merged afterwards.
+	constexpr size_t grain = 64 * 1024;
+	const size_t jobCount = (static_cast<size_t>(pointCount) + grain - 1) / grain;
+	std::vector<glm::vec3> minima(jobCount), maxima(jobCount);
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.ParallelFor(pointCount, grain, [&](size_t begin, size_t end)
+	{
+		glm::vec3 minimum(points[begin * 3], points[begin * 3 + 1], points[begin * 3 + 2]);
+		glm::vec3 maximum = minimum;
+		for (size_t i = begin + 1; i < end; ++i)
+		{
+			glm::vec3 point(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+			minimum = glm::min(minimum, point);
+			maximum = glm::max(maximum, point);
+		}
+		minima[begin / grain] = minimum;
+		maxima[begin / grain] = maximum;
+	}));
+
+	glm::vec3 minimum = minima[0], maximum = maxima[0];
+	for (size_t i = 1; i < jobCount; ++i)
+	{
+		minimum = glm::min(minimum, minima[i]);
+		maximum = glm::max(maximum, maxima[i]);
+	}
+
+	glm::vec3 center = (minimum + maximum) * 0.5f;
+	return glm::vec4(center, glm::length(maximum - center));
+}
+
+// Lookdev rig: alternating point and spot lights on a rising spiral around the models.
+std::vector<ClusteredLights::PunctualLight> CreateLightRig(uint32_t count)
+{
+	std::vector<ClusteredLights::PunctualLight> lights(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		float t = count > 1 ? static_cast<float>(i) / (count - 1) : 0.0f;
+		float angle = glm::two_pi<float>() * 3.0f * t;
+
+		ClusteredLights::PunctualLight& light = lights[i];
+		light.position = glm::vec3(glm::sin(angle) * 3.0f, t * 3.0f - 1.0f, glm::cos(angle) * 3.0f);
+		light.range = 2.5f;
+		light.color = glm::vec3(0.5f + 0.5f * glm::cos(angle), 0.5f + 0.5f * glm::cos(angle + 2.1f), 0.5f + 0.5f * glm::cos(angle + 4.2f)) * 2.0f;
+		if (i % 2)
+		{
+			light.type = ClusteredLights::Spot;
+			light.direction = glm::normalize(-light.position);
+			light.cosOuter = glm::cos(glm::radians(35.0f));
+			light.cosInner = glm::cos(glm::radians(25.0f));
+		}
+	}
+	return lights;
+}
+
+void LoadHairModel(const char* filename, cyHairFile& hairfile)
 {
 	// Load the hair model
 	int result = hairfile.LoadFromFile(filename);
@@ -104,52 +252,48 @@ void LoadHairModel(const char* filename, cyHairFile& hairfile, float*& dirs)
 	int pointCount = hairfile.GetHeader().point_count;
 	LOG_RUNTIME_INFO("Number of hair strands = {}", hairCount);
 	LOG_RUNTIME_INFO("Number of hair points = {}", pointCount);
-	// Compute directions
-	if (hairfile.FillDirectionArray(dirs) == 0) {
-		LOG_RUNTIME_WARN("Cannot compute hair directions!");
-	}
 }
 
-void APIENTRY gldebugmessage_callback(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
+// The independent passes over a loaded hair model, side by side as jobs.
+void BuildHairGeometry(const cyHairFile& hairfile, std::vector<Meshlet>& meshlets, std::vector<Meshlet>& ribbonMeshlets, glm::vec4& bounds)
 {
-	// ignore non-significant error/warning codes
-	if (id == 131169 || id == 131185 || id == 131218 || id == 131204) return;
+	JobSystem& jobs = JobSystem::Get();
+	jobs.Wait(jobs.Run([]() {}, {
+		jobs.Run([&]() { meshlets = BuildMeshlets(hairfile); }),
+		jobs.Run([&]() { ribbonMeshlets = BuildRibbonMeshlets(hairfile); }),
+		jobs.Run([&]() { bounds = ComputeBoundingSphere(hairfile); }),
+	}));
+}
 
-	std::string src;
-	switch (source)
-	{
-	case GL_DEBUG_SOURCE_API:             src = "API"; break;
-	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   src = "Window System"; break;
-	case GL_DEBUG_SOURCE_SHADER_COMPILER: src = "Shader Compiler"; break;
-	case GL_DEBUG_SOURCE_THIRD_PARTY:     src = "Third Party"; break;
-	case GL_DEBUG_SOURCE_APPLICATION:     src = "Application"; break;
-	case GL_DEBUG_SOURCE_OTHER:           src = "Other"; break;
-	}
+// Logs how the CPU load stages scale from one to every hardware thread, for --job-scaling.
+void ReportJobScaling(const cyHairFile& hairfile, const std::filesystem::path& cubeMapFolder)
+{
+	const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
 
-	std::string ty;
-	switch (type)
-	{
-	case GL_DEBUG_TYPE_ERROR:               ty = "Error"; break;
-	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: ty = "Deprecated Behaviour"; break;
-	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  ty = "Undefined Behaviour"; break;
-	case GL_DEBUG_TYPE_PORTABILITY:         ty = "Portability"; break;
-	case GL_DEBUG_TYPE_PERFORMANCE:         ty = "Performance"; break;
-	case GL_DEBUG_TYPE_MARKER:              ty = "Marker"; break;
-	case GL_DEBUG_TYPE_PUSH_GROUP:          ty = "Push Group"; break;
-	case GL_DEBUG_TYPE_POP_GROUP:           ty = "Pop Group"; break;
-	case GL_DEBUG_TYPE_OTHER:               ty = "Other"; break;
-	}
+	std::vector<Meshlet> meshlets, ribbonMeshlets;
+	glm::vec4 bounds;
+	std::vector<double> hair = JobSystem::MeasureScaling(maxThreads, 5, [&]() { BuildHairGeometry(hairfile, meshlets, ribbonMeshlets, bounds); });
 
-	std::string svr;
-	switch (severity)
+	std::vector<std::filesystem::path> faces = GetCubeMapFaces(cubeMapFolder);
+	std::string files[6];
+	for (int i = 0; i < 6; ++i)
+		files[i] = faces[i].string();
+	const int size = GetCubeMapSize(files);
+	const size_t faceBytes = static_cast<size_t>(size) * size * 4;
+	std::vector<unsigned char> pixels(faceBytes * 6);
+	std::vector<double> decode = JobSystem::MeasureScaling(maxThreads, 1, [&]()
 	{
-	case GL_DEBUG_SEVERITY_HIGH:         svr = "Severity: high"; break;
-	case GL_DEBUG_SEVERITY_MEDIUM:       svr = "Severity: medium"; break;
-	case GL_DEBUG_SEVERITY_LOW:          svr = "Severity: low"; break;
-	case GL_DEBUG_SEVERITY_NOTIFICATION: svr = "Severity: notification"; break;
-	}
-
-	LOG_OPENGL_ERROR("Debug Message ({}):{}\nSource: {}\nType: {}\nSeverity: {}\n", id, message, src, ty, svr);
+		JobSystem& jobs = JobSystem::Get();
+		jobs.Wait(jobs.ParallelFor(6, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				DecodeCubeMapFace(files[i], size, pixels.data() + i * faceBytes);
+		}));
+	});
+
+	LOG_RUNTIME_INFO("Job scaling, fastest run in ms and speedup over 1 thread:");
+	for (unsigned i = 0; i < maxThreads; ++i)
+		LOG_RUNTIME_INFO("{:>3} threads: hair geometry {:8.2f} ({:.2f}x), cube map decode {:8.1f} ({:.2f}x)", i + 1, hair[i], hair[0] / hair[i], decode[i], decode[0] / decode[i]);
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -209,128 +353,202 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	Camera::Instance().SetAspect(width, height);
 }
 
-GLuint CreateCubeMap(std::filesystem::path path)
-{
-	GLuint textureID;
-	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
-
-	static const char* const filenames[] = {
-		"px.png",
-		"nx.png",
-		"py.png",
-		"ny.png",
-		"pz.png",
-		"nz.png"
-	};
-
-	glTextureStorage2D(textureID, 1, GL_RGB8, 2048, 2048);
-	int width, height, nrChannels;
-	for (int i = 0; i < 6; ++i)
-	{
-		unsigned char* data = stbi_load((path / filenames[i]).string().c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-			glTextureSubImage3D(textureID, 0, 0, 0, i, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, data);
-		else
-			LOG_RUNTIME_WARN("Cubemap tex failed to load at path: {}", path.string());
-		stbi_image_free(data);
-	}
-	glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
-}
-
 int main(int argc, char* argv[])
 {
 	Logger::Init();
-	
+	Options options = Options::Parse(argc, argv);
+	// A benchmark without --summary prints its JSON to stdout, so the log moves out of the way.
+	Logger::Configure(options.asyncLog, options.logFile, options.benchmark);
+	// Get() for every loader below; the main thread helps out while it waits.
+	JobSystem jobs(options.threads ? options.threads : std::thread::hardware_concurrency());
+	LOG_RUNTIME_INFO("Job system: {} threads", jobs.GetThreadCount());
+
+	GLFWwindow* window = nullptr;
+	HeadlessContext headless;
+
+	// Surfaceless EGL needs no window system, everywhere else GLFW provides the context.
+#if defined(__linux__)
+	bool needGLFW = !options.headless;
+#else
+	bool needGLFW = true;
+#endif
+
 	// Init GLFW3.
-	if (!glfwInit()) 
+	if (needGLFW && !glfwInit()) 
 	{
 		LOG_RUNTIME_ERROR("failed to initialize GLFW.");
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
-	glfwWindowHint(GLFW_SAMPLES, 8);
-
-	auto window = glfwCreateWindow(1920, 1440, "Ivysaur", nullptr, nullptr);
-	if (!window) 
+	if (options.headless)
 	{
-		glfwTerminate();
-		return -1;
+		if (!headless.Create(4, 6, options.glProfile))
+		{
+			glfwTerminate();
+			return -1;
+		}
+
+		// Init gl loader.
+		if (gl3wInit2(headless.GetProcAddress()))
+		{
+			LOG_RUNTIME_ERROR("failed to initialize OpenGL");
+			return -1;
+		}
+
+		Camera::Instance().SetAspect(options.width, options.height);
 	}
+	else
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, options.glProfile == GLProfile::Debug ? GL_TRUE : GL_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_NO_ERROR, options.glProfile == GLProfile::Production ? GLFW_TRUE : GLFW_FALSE);
+		// The scene is multisampled in the render graph, the default framebuffer only receives the resolve.
+		glfwWindowHint(GLFW_SAMPLES, 0);
+
+		window = glfwCreateWindow(options.width, options.height, "Ivysaur", nullptr, nullptr);
+		if (!window) 
+		{
+			glfwTerminate();
+			return -1;
+		}
+
+		// Benchmarks are driven by their script only.
+		if (!options.benchmark)
+		{
+			glfwSetKeyCallback(window, key_callback);
+			glfwSetCursorPosCallback(window, cursor_position_callback);
+			glfwSetMouseButtonCallback(window, mouse_button_callback);
+		}
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+		glfwMakeContextCurrent(window);
+		// Measure frames, not the display's refresh rate.
+		if (options.benchmark)
+			glfwSwapInterval(0);
+		Camera::Instance().SetAspect(options.width, options.height);
+
+		// Setup Dear ImGui context
+		IMGUI_CHECKVERSION();
+		ImGui::CreateContext();
+		ImGuiIO& io = ImGui::GetIO(); (void)io;
+		const char* font = "C:\\Windows\\Fonts\\segoeui.ttf";
+		if (std::filesystem::exists(font))
+			io.Fonts->AddFontFromFileTTF(font, 24 * 2);
+		else
+			io.Fonts->AddFontDefault();
 
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, cursor_position_callback);
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-
-	glfwMakeContextCurrent(window);
+		//io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+		//io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
 
-	// Setup Dear ImGui context
-	IMGUI_CHECKVERSION();
-	ImGui::CreateContext();
-	ImGuiIO& io = ImGui::GetIO(); (void)io;
-	io.Fonts->AddFontFromFileTTF("C:\\Windows\\Fonts\\segoeui.ttf", 24 * 2);
+		// Setup Dear ImGui style
+		ImGui::StyleColorsDark();
+		//ImGui::StyleColorsLight();
 
-	//io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
-	//io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
+		// Setup Platform/Renderer backends
+		ImGui_ImplGlfw_InitForOpenGL(window, true);
+		ImGui_ImplOpenGL3_Init("#version 450");
 
-	// Setup Dear ImGui style
-	ImGui::StyleColorsDark();
-	//ImGui::StyleColorsLight();
+		// Init gl loader.
+		if (gl3wInit()) 
+		{
+			LOG_RUNTIME_ERROR("failed to initialize OpenGL");
+			return -1;
+		}
+	}
 
-	// Setup Platform/Renderer backends
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
-	ImGui_ImplOpenGL3_Init("#version 450");
+	LOG_RUNTIME_INFO("OpenGL {0}, GLSL {1}", reinterpret_cast<const char*>(glGetString(GL_VERSION)), reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
 
-	// Init gl loader.
-	if (gl3wInit()) 
+	// Every geometry pass is a task and mesh shader pipeline, without them a frame is GL errors.
+	if (!HasGLExtension("GL_NV_mesh_shader"))
 	{
-		LOG_RUNTIME_ERROR("failed to initialize OpenGL");
+		LOG_RUNTIME_CRITICAL("{} does not support GL_NV_mesh_shader, which every render pass needs.", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
 		return -1;
 	}
 
-	LOG_RUNTIME_INFO("OpenGL {0}, GLSL {1}", reinterpret_cast<const char*>(glGetString(GL_VERSION)), reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
-
 	GLint max_vertices, max_primitives;
 	glGetIntegerv(GL_MAX_MESH_OUTPUT_VERTICES_NV, &max_vertices);
 	glGetIntegerv(GL_MAX_MESH_OUTPUT_PRIMITIVES_NV, &max_primitives);
 	LOG_RUNTIME_INFO("Max mesh output vertices: {0}, primitives {1}", max_vertices, max_primitives);
 
-	// Setup debug logger.
-	int flags; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
-	if (flags & GL_CONTEXT_FLAG_DEBUG_BIT)
+	// Debug output in the debug profile; a production context reports no errors at all.
+	GLDebugOutput glDebug;
+	if (options.glProfile == GLProfile::Debug)
+	{
+		if (!glDebug.Enable())
+			LOG_RUNTIME_WARN("The driver did not create a debug context, GL debug output is off.");
+	}
+	else
 	{
-		glEnable(GL_DEBUG_OUTPUT);
-		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-		glDebugMessageCallback(gldebugmessage_callback, nullptr);
-		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
-		//glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_ERROR, GL_DEBUG_SEVERITY_HIGH, 0, nullptr, GL_TRUE);
+		GLint flags = 0; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+		LOG_RUNTIME_INFO("Production GL context{}.", (flags & GL_CONTEXT_FLAG_NO_ERROR_BIT) ? " without error checking" : ", the driver does not support KHR_no_error");
 	}
 
 	cyHairFile hair = cyHairFile();
-	float* dirs = nullptr;
-	LoadHairModel("Assets/Models/wWavyThin.hair", hair, dirs);
-	std::vector<Meshlet> meshlets = BuildMeshlets(hair);
-
-	// Shader compilation.
-	//std::shared_ptr<Shader> skyboxMesh = std::make_shared<Shader>("skybox.mesh");
-	//std::shared_ptr<Shader> skyboxFrag = std::make_shared<Shader>("skybox.frag");
-	//Program skybox_program;
-	//skybox_program.Link(skyboxMesh, skyboxFrag);
-
-	//std::shared_ptr<Shader> hairMesh = std::make_shared<Shader>("hair.mesh");
-	//std::shared_ptr<Shader> hairFrag = std::make_shared<Shader>("hair.frag");
-	//Program hair_program;
-	//hair_program.Link(hairMesh, hairFrag);
+	LoadHairModel("Assets/Models/wWavyThin.hair", hair);
+	std::vector<Meshlet> meshlets, ribbonMeshlets;
+	glm::vec4 hairBounds;
+	BuildHairGeometry(hair, meshlets, ribbonMeshlets, hairBounds);
+	// Bumped whenever the hair points change, so the deep opacity maps know to regenerate. The
+	// points are static for now (SSBO 0 is immutable); a simulation bumps it when it writes them.
+	uint32_t hairSimulationVersion = 0;
+
+	// Device limits and the constants shaders share with the C++ side, defined in every shader.
+	// Line mode draws whole strands, so its outputs are sized for the longest one the device allows.
+	GLint longestStrand = 2;
+	for (const Meshlet& meshlet : meshlets)
+		longestStrand = std::max(longestStrand, static_cast<GLint>(meshlet.vertex_count));
+	GLint hairMaxPoints = std::min({ longestStrand, static_cast<GLint>(max_vertices), static_cast<GLint>(max_primitives + 1) });
+	if (hairMaxPoints < longestStrand)
+		LOG_RUNTIME_WARN("Hair lines are cut to {} of up to {} points per strand.", hairMaxPoints, longestStrand);
+	// Decided before the shaders, since their material path follows it.
+	MaterialSystem materials(!options.spirv);
+	ShaderDefines shaderDefines = {
+		{ "MAX_MESH_OUTPUT_VERTICES", std::to_string(max_vertices) },
+		{ "MAX_MESH_OUTPUT_PRIMITIVES", std::to_string(max_primitives) },
+		{ "HAIR_MAX_POINTS", std::to_string(hairMaxPoints) },
+		{ "RIBBON_CHUNK_POINTS", std::to_string(s_RibbonChunkPoints) },
+		{ "MESHLET_MAX_VERTICES", std::to_string(Mesh::s_MaxVertices) },
+		{ "MESHLET_MAX_TRIANGLES", std::to_string(Mesh::s_MaxTriangles) },
+		{ "MESHLET_TRIANGLE_BITS", std::to_string(Mesh::s_TriangleBits) },
+		{ "BINDLESS_MATERIALS", materials.IsBindless() ? "1" : "0" },
+	};
+	// With --spirv these are also saved for ShaderCompiler, which needs them to build matching modules.
+	LOG_RUNTIME_INFO("Shader defines: {}", ShaderPreprocessor::ToString(shaderDefines));
+	Shader::SetGlobalDefines(shaderDefines);
+
+	// Shader compilation: every Link() only submits its stages, the driver compiles them all at once.
+	Shader::UseEmbedded(options.embeddedShaders);
+	Shader::UseSpirv(options.spirv);
+	std::shared_ptr<Shader> skyboxMesh = std::make_shared<Shader>("skybox.mesh");
+	std::shared_ptr<Shader> skyboxFrag = std::make_shared<Shader>("skybox.frag");
+	Program skybox_program;
+	skybox_program.Link(skyboxMesh, skyboxFrag);
+
+	std::shared_ptr<Shader> hairMesh = std::make_shared<Shader>("hair.mesh");
+	std::shared_ptr<Shader> hairFrag = std::make_shared<Shader>("hair.frag");
+	Program hair_program;
+	hair_program.Link(hairMesh, hairFrag);
+
+	std::shared_ptr<Shader> hairDebugMesh = std::make_shared<Shader>("hair.mesh", ShaderDefines{ { "DEBUG_MESHLET_COLORS", "1" } });
+	Program hair_debug_program;
+	hair_debug_program.Link(hairDebugMesh, hairFrag);
+
+	std::shared_ptr<Shader> hairCoverageMesh = std::make_shared<Shader>("hair_coverage.mesh");
+	Program hair_coverage_program;
+	hair_coverage_program.Link(hairCoverageMesh, hairFrag);
+
+	std::shared_ptr<Shader> hairRibbonMesh = std::make_shared<Shader>("hair_ribbon.mesh");
+	Program hair_ribbon_program;
+	hair_ribbon_program.Link(hairRibbonMesh, hairFrag);
+
+	std::shared_ptr<Shader> hairDepthFrag = std::make_shared<Shader>("hair_depth.frag");
+	std::shared_ptr<Shader> hairOpacityFrag = std::make_shared<Shader>("hair_opacity.frag");
+	Program hair_depth_program;
+	hair_depth_program.Link(hairMesh, hairDepthFrag);
+	Program hair_opacity_program;
+	hair_opacity_program.Link(hairMesh, hairOpacityFrag);
 
 	std::shared_ptr<Shader> cube_task = std::make_shared<Shader>("cube.task");
 	std::shared_ptr<Shader> cube_mesh = std::make_shared<Shader>("cube.mesh");
@@ -338,6 +556,32 @@ int main(int argc, char* argv[])
 	Program cube_program;
 	cube_program.Link(cube_task, cube_mesh, base_frag);
 
+	std::shared_ptr<Shader> gltfMesh = std::make_shared<Shader>("base.mesh");
+	std::shared_ptr<Shader> gltfFrag = std::make_shared<Shader>("gltf.frag");
+	std::shared_ptr<Shader> gltfVisibilityFrag = std::make_shared<Shader>("gltf_visibility.frag");
+	std::shared_ptr<Shader> fullscreenMesh = std::make_shared<Shader>("fullscreen.mesh");
+	std::shared_ptr<Shader> gltfResolveFrag = std::make_shared<Shader>("gltf_resolve.frag");
+	Program gltf_program;
+	gltf_program.Link(gltfMesh, gltfFrag);
+	Program gltf_visibility_program;
+	gltf_visibility_program.Link(gltfMesh, gltfVisibilityFrag);
+	Program gltf_resolve_program;
+	gltf_resolve_program.Link(fullscreenMesh, gltfResolveFrag);
+
+	std::shared_ptr<Shader> lightCullComp = std::make_shared<Shader>("light_cull.comp");
+	Program light_cull_program;
+	light_cull_program.Link(lightCullComp);
+
+	std::shared_ptr<Shader> iblPrefilterComp = std::make_shared<Shader>("ibl_prefilter.comp");
+	std::shared_ptr<Shader> iblIrradianceComp = std::make_shared<Shader>("ibl_irradiance.comp");
+	Program ibl_prefilter_program;
+	ibl_prefilter_program.Link(iblPrefilterComp);
+	Program ibl_irradiance_program;
+	ibl_irradiance_program.Link(iblIrradianceComp);
+
+	Program::WaitAll();
+	bool iblLinked = ibl_prefilter_program.IsLinked() && ibl_irradiance_program.IsLinked();
+
 
 	GLuint UBOs[2];	glCreateBuffers(2, UBOs);
 	glBindBuffersBase(GL_UNIFORM_BUFFER, 0, 2, UBOs);
@@ -345,20 +589,85 @@ int main(int argc, char* argv[])
 	glNamedBufferData(UBOs[1], sizeof(Light), nullptr, GL_STATIC_DRAW);
 
 
-	//glProgramUniform4f(hair_program.GetID(), 0, hair.GetHeader().d_color[0], hair.GetHeader().d_color[1], hair.GetHeader().d_color[2], hair.GetHeader().d_transparency);
-
-	GLuint SSBOs[2]; glCreateBuffers(2, SSBOs);
-	glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, 2, SSBOs);
+	glProgramUniform4f(hair_program.GetStageID(GL_MESH_SHADER_NV), 0, hair.GetHeader().d_color[0], hair.GetHeader().d_color[1], hair.GetHeader().d_color[2], hair.GetHeader().d_transparency);
+	glProgramUniform4f(hair_coverage_program.GetStageID(GL_MESH_SHADER_NV), 0, hair.GetHeader().d_color[0], hair.GetHeader().d_color[1], hair.GetHeader().d_color[2], hair.GetHeader().d_transparency);
+	glProgramUniform4f(hair_ribbon_program.GetStageID(GL_MESH_SHADER_NV), 0, hair.GetHeader().d_color[0], hair.GetHeader().d_color[1], hair.GetHeader().d_color[2], hair.GetHeader().d_transparency);
+	// Coverage and ribbons antialias the hair by themselves, so the scene drops to one sample.
+	HairMode hairMode = options.hairMode;
+	// Strand width in coverage mode, minimum ribbon width in ribbon mode.
+	float hairWidthPixels = 1.0f;
+	// Lines mode only, the DEBUG_MESHLET_COLORS variant of hair.mesh.
+	bool hairMeshletColors = false;
+
+	DeepOpacityMap hairShadow;
+	float hairShadowDensity = 0.1f;
+	hairShadow.SetDensity(hairShadowDensity);
+	// Revisions of the programs that render the maps, see the hot reload in the frame loop.
+	uint32_t hairShadowPrograms = 0;
+
+	GLuint SSBOs[4]; glCreateBuffers(4, SSBOs);
+	glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, 3, SSBOs);
 	// vertices
 	glNamedBufferStorage(SSBOs[0], sizeof(float) * 3 * hair.GetHeader().point_count, hair.GetPointsArray(), GL_NONE);
 	// meshlets
 	glNamedBufferStorage(SSBOs[1], sizeof(Meshlet) * meshlets.size(), meshlets.data(), GL_NONE);
-
-	GLuint skyboxTexture = CreateCubeMap("Assets/Textures/Clarens Night 02/");
+	// per-point thickness, the default thickness when the file has none
+	std::vector<float> thickness(hair.GetHeader().point_count, hair.GetHeader().d_thickness);
+	if (hair.GetThicknessArray())
+		thickness.assign(hair.GetThicknessArray(), hair.GetThicknessArray() + hair.GetHeader().point_count);
+	glNamedBufferStorage(SSBOs[2], sizeof(float) * thickness.size(), thickness.data(), GL_NONE);
+	// strand chunks, bound in place of the meshlets for ribbon and coverage draws
+	glNamedBufferStorage(SSBOs[3], sizeof(Meshlet) * ribbonMeshlets.size(), ribbonMeshlets.data(), GL_NONE);
+
+	// glTF meshes, SSBO bindings 3 to 6.
+	Mesh helmet;
+	helmet.Load("Assets/Models/DamagedHelmet.gltf", materials);
+	helmet.Bind(3);
+	// Materials of every mesh in one SSBO, binding 12.
+	materials.Upload();
+	materials.Bind();
+	// Forward shading runs per rasterized fragment, the visibility buffer once per pixel.
+	bool useVisibilityBuffer = true;
+
+	ClusteredLights clusteredLights;
+	int lightCount = 32;
+	clusteredLights.SetLights(CreateLightRig(lightCount));
+	bool validateLights = false;
+
+	const std::filesystem::path skyboxFolder = "Assets/Textures/Clarens Night 02/";
+	if (options.jobScaling)
+		ReportJobScaling(hair, skyboxFolder);
+	GLuint skyboxTexture = CreateCubeMap(skyboxFolder);
 	glBindTextureUnit(0, skyboxTexture);
 
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+	// The cube grid, the helmet and the hair on a turntable. Cube nodes are created in a row so
+	// their world matrices are contiguous and go to the cube shaders as they are, SSBO 13.
+	Scene scene;
+	const Scene::Node cubeRoot = scene.Create();
+	scene.SetPosition(cubeRoot, glm::vec3(1.0f, 0.0f, 0.0f));
+	const Scene::Node firstCube = cubeRoot + 1;
+	const unsigned cubeCount = options.cubes;
+	const unsigned cubeSide = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<float>(cubeCount))));
+	for (unsigned i = 0; i < cubeCount; ++i)
+		scene.SetPosition(scene.Create(cubeRoot), glm::vec3(static_cast<float>(i / cubeSide), static_cast<float>(i % cubeSide), 0.0f));
+	const Scene::Node helmetNode = scene.Create();
+	scene.SetPosition(helmetNode, glm::vec3(-2.0f, 0.0f, 0.0f));
+	const Scene::Node turntable = scene.Create();
+	const Scene::Node hairNode = scene.Create(turntable);
+	scene.SetRotation(hairNode, glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+	scene.SetScale(hairNode, glm::vec3(0.01f));
+
+	GLuint cubeTransforms; glCreateBuffers(1, &cubeTransforms);
+	glNamedBufferStorage(cubeTransforms, sizeof(glm::mat4) * cubeCount, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, cubeTransforms);
+
+	// Ambient lighting for the hair and meshes, texture unit 5 and UBO 4.
+	EnvironmentLighting environment;
+	environment.Create(skyboxTexture, GetCubeMapFaces(skyboxFolder), ibl_prefilter_program, ibl_irradiance_program, iblLinked && !options.headless);
+	environment.Bind();
+
 	// Set to line mode.
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	//glLineWidth(2);
@@ -371,79 +680,509 @@ int main(int argc, char* argv[])
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_MULTISAMPLE);
 
-	GLfloat clearColor[] = { 0.32f, 0.51f, 0.39f, 1.0f };
-	GLfloat* clearDepth = new GLfloat(1.0f);
+	glm::vec4 clearColor = { 0.32f, 0.51f, 0.39f, 1.0f };
+	float clearDepth = 1.0f;
 	
 	MatrixUBO ubo;
+	// Every pass fills the whole block before drawing: UBO 0 is not a graph resource, so no pass
+	// may rely on what another one left in it.
+	auto uploadMatrices = [&ubo, &UBOs](const glm::mat4& viewProjection, const glm::mat4& model)
+	{
+		ubo.VP = viewProjection;
+		ubo.M = model;
+		ubo.CameraPos = Camera::Instance().GetPosition();
+		glNamedBufferSubData(UBOs[0], 0, sizeof(MatrixUBO), &ubo);
+	};
 	Light sun;
 
-	// Render loop.
-	while (!glfwWindowShouldClose(window))
+	RenderGraph graph;
+
+	Profiler& profiler = Profiler::Instance();
+	if (!options.profileCsv.empty())
+		profiler.StartCapture(options.profileCsv);
+
+	// Headless frames go to an offscreen target and optionally to disk.
+	std::unique_ptr<FrameWriter> frameWriter;
+	if (options.headless)
+		frameWriter = std::make_unique<FrameWriter>(options.width, options.height, options.outputFolder);
+
+	GLint maxSamples = 1; glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	GLsizei sceneSamples = std::min(8, static_cast<int>(maxSamples));
+
+	std::unique_ptr<Benchmark> benchmark;
+	if (options.benchmark)
 	{
-		glfwPollEvents();
+		benchmark = std::make_unique<Benchmark>();
+		if (options.benchmarkScript.empty() || !benchmark->Load(options.benchmarkScript))
+			benchmark->UseDefaultPath(options.framesGiven ? options.frames : 600);
+		profiler.SetFrameCallback([&benchmark](uint64_t frame, const std::vector<Profiler::ScopeResult>& results)
+		{
+			benchmark->AddProfilerFrame(frame, results);
+		});
+		benchmark->SetSetting("hair", GetHairModeName(hairMode));
+		benchmark->SetSetting("scene_samples", hairMode == HairMode::Lines ? sceneSamples : 1);
+	}
 
-		glClearNamedFramebufferfv(0, GL_COLOR, 0, clearColor);
-		glClearNamedFramebufferfv(0, GL_DEPTH, 0, clearDepth);
+	std::unique_ptr<BenchmarkRecorder> recorder;
+	if (!options.recordScript.empty() && !options.benchmark)
+		recorder = std::make_unique<BenchmarkRecorder>();
 
-		// Send cubemap matrix.
-		ubo = { Camera::Instance().GetProjectionMatrix(), Camera::Instance().GetRotationMatrix() };
-		glNamedBufferSubData(UBOs[0], 0, sizeof(MatrixUBO), &ubo);
+	auto keepRunning = [&](uint64_t frame)
+	{
+		if (window && glfwWindowShouldClose(window))
+			return false;
+		if (benchmark)
+			return frame < benchmark->GetTotalFrames();
+		return window != nullptr || frame < static_cast<uint64_t>(options.frames);
+	};
 
-		// Draw skybox.
-		glDepthFunc(GL_LEQUAL);
-		//skybox_program.Use();
-		//glDrawMeshTasksNV(0, 1);
-		glDepthFunc(GL_LESS);
+	// Startup state is bound now, let the drivers finish their first-draw work before frame 0.
+	Program::WarmUp();
 
-		// Uniform Buffer
-		ubo.VP = Camera::Instance().GetViewProjection();
-		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		ubo.M = model;
-		ubo.CameraPos = Camera::Instance().GetPosition();
-		glNamedBufferSubData(UBOs[0], 0, sizeof(MatrixUBO), &ubo);
-		
-		cube_program.Use();
-		glDrawMeshTasksNV(0, 1);
+	// Edited shaders are recompiled in the background while the old programs keep rendering.
+	std::unique_ptr<ShaderWatcher> shaderWatcher;
+	if (window && !options.benchmark)
+		shaderWatcher = std::make_unique<ShaderWatcher>("Assets/Shaders/");
 
+	// Debug builds count the main thread's heap allocations; a warm frame should not make any.
+	const uint64_t heapWarmupFrames = Profiler::s_FramesInFlight * 4;
+	uint64_t heapFrameAllocations = 0, heapAllocatingFrames = 0;
 
-		// Send hair matrix.
-		model = glm::scale(glm::mat4(1.0f), glm::vec3(0.01f));
-		model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		model = toMat4(rotateY) * model;
-		ubo.M = model;
-		glNamedBufferSubData(UBOs[0], 0, sizeof(MatrixUBO), &ubo);
+	// Render loop.
+	uint64_t frameIndex = 0;
+	auto frameStart = std::chrono::high_resolution_clock::now();
+	while (keepRunning(frameIndex))
+	{
+		auto now = std::chrono::high_resolution_clock::now();
+		if (benchmark && frameIndex > 0)
+			benchmark->AddFrameTime(frameIndex - 1, std::chrono::duration<double, std::milli>(now - frameStart).count());
+		frameStart = now;
+
+		int width = options.width, height = options.height;
+		if (window)
+		{
+			glfwPollEvents();
+			glfwGetFramebufferSize(window, &width, &height);
+			if (width == 0 || height == 0)
+				continue;
+		}
+
+		// The graph lets go of last frame's passes before their arena memory is reused.
+		graph.Reset();
+		LinearArena::Frame().Reset();
+		const uint64_t heapAllocations = HeapCounter::Get();
+
+		profiler.BeginFrame();
+
+		if (shaderWatcher)
+			Program::Reload(shaderWatcher->TakeChanges());
+		Program::PollBuilds();
+		// A reloaded hair depth or opacity stage renders different maps from the same inputs.
+		const uint32_t hairShadowRevision = hair_depth_program.GetRevision() + hair_opacity_program.GetRevision();
+		if (hairShadowRevision != hairShadowPrograms)
+		{
+			hairShadowPrograms = hairShadowRevision;
+			hairShadow.Invalidate();
+		}
+
+		if (benchmark)
+			benchmark->Apply(frameIndex, Camera::Instance(), rotateY);
+		if (recorder)
+			recorder->Record(Camera::Instance(), rotateY);
+
+		scene.SetRotation(helmetNode, rotateY);
+		scene.SetRotation(turntable, rotateY);
+		{
+			PROFILE_SCOPE("Scene update");
+			scene.Update();
+		}
+		const glm::mat4& helmetModel = scene.GetWorld(helmetNode);
+		const glm::mat4& hairModel = scene.GetWorld(hairNode);
+		if (scene.HasChanged(firstCube, cubeCount))
+			glNamedBufferSubData(cubeTransforms, 0, sizeof(glm::mat4) * cubeCount, scene.GetWorldMatrices() + firstCube);
 
 		sun.direction = glm::vec3(1.0f, 1.0f, 1.0f);
 		sun.color = glm::vec3(0.1f, 0.3f, 2.0f) * 3.0f;
 		glNamedBufferSubData(UBOs[1], 0, sizeof(Light), &sun);
 
-		// Draw Hair.
-		//hair_program.Use();
-		//glDrawMeshTasksNV(0, hair.GetHeader().hair_count);
-
+		// Regenerate hair self-shadowing only when the light, groom or simulation changed.
+		bool hairShadowRegenerated = hairShadow.IsDirty(sun.direction, hairModel, hairSimulationVersion);
 
 		// Start the Dear ImGui frame
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
-		ImGui::Begin("Shaders:", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
-		if (ImGui::Button("Refresh cube program"))
-			cube_program.Update();
-		ImGui::End();
+		if (window)
+		{
+			PROFILE_SCOPE("UI build");
+			ImGuiIO& io = ImGui::GetIO();
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+			ImGui::Begin("Shaders:", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
+			if (ImGui::Button("Reload all programs"))
+				Program::ReloadAll();
+			if (ImGui::SliderFloat("Hair shadow density", &hairShadowDensity, 0.0f, 1.0f))
+				hairShadow.SetDensity(hairShadowDensity);
+			ImGui::Checkbox("Visibility buffer", &useVisibilityBuffer);
+			int hairModeIndex = static_cast<int>(hairMode);
+			if (ImGui::Combo("Hair", &hairModeIndex, "Lines (MSAA)\0Analytic coverage (1x)\0Ribbons (1x)\0"))
+				hairMode = static_cast<HairMode>(hairModeIndex);
+			if (hairMode == HairMode::Lines)
+				ImGui::Checkbox("Hair meshlet colors", &hairMeshletColors);
+			else if (hairMode == HairMode::Coverage)
+				ImGui::SliderFloat("Hair width (pixels)", &hairWidthPixels, 0.25f, 4.0f);
+			else if (hairMode == HairMode::Ribbons)
+				ImGui::SliderFloat("Minimum hair width (pixels)", &hairWidthPixels, 0.25f, 4.0f);
+			if (ImGui::SliderInt("Lights", &lightCount, 0, ClusteredLights::s_MaxLights))
+				clusteredLights.SetLights(CreateLightRig(lightCount));
+			if (ImGui::Button("Validate light clusters"))
+				validateLights = true;
+			ImVec2 timingPos(ImGui::GetWindowPos().x + ImGui::GetWindowSize().x + 8.0f, ImGui::GetWindowPos().y);
+			ImGui::End();
+
+			const RenderGraph::Stats& graphStats = graph.GetStats();
+			ImGui::SetNextWindowPos(timingPos, ImGuiCond_FirstUseEver);
+			ImGui::Begin("Frame timing:", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
+			ImGui::Text("Frame: %.2f ms (%.0f FPS)", 1000.0f / io.Framerate, io.Framerate);
+			float hairShadowCost = profiler.GetLastGpuTime("Hair shadow depth") + profiler.GetLastGpuTime("Hair shadow opacity");
+			ImGui::Text("Hair deep opacity maps: %.3f ms (%s)", hairShadowCost, hairShadowRegenerated ? "regenerated" : "cached");
+			if (useVisibilityBuffer)
+				ImGui::Text("Helmet: visibility %.3f ms + resolve %.3f ms", profiler.GetLastGpuTime("Helmet visibility"), profiler.GetLastGpuTime("Helmet resolve"));
+			else
+				ImGui::Text("Helmet: forward %.3f ms", profiler.GetLastGpuTime("Helmet forward"));
+			ImGui::Text("Hair: %.3f ms, scene at %dx", profiler.GetLastGpuTime("Hair"), hairMode == HairMode::Lines ? static_cast<int>(sceneSamples) : 1);
+			ImGui::Text("Render graph: %u passes, %u culled, %u barriers", graphStats.passes, graphStats.culledPasses, graphStats.barriers);
+			ImGui::Text("Transients: %u -> %u objects, %.1f -> %.1f MB", graphStats.transientResources, graphStats.physicalResources,
+				graphStats.transientBytes / (1024.0f * 1024.0f), graphStats.physicalBytes / (1024.0f * 1024.0f));
+			ImGui::Text("Frame arena: %.1f of %.1f KB", LinearArena::Frame().GetUsed() / 1024.0f, LinearArena::Frame().GetCapacity() / 1024.0f);
+			if (HeapCounter::s_Enabled)
+				ImGui::Text("Heap allocations: %llu last frame, %llu frames allocated after warm-up", static_cast<unsigned long long>(heapFrameAllocations),
+					static_cast<unsigned long long>(heapAllocatingFrames));
+			profiler.DrawTable();
+			if (glDebug.IsEnabled())
+				glDebug.DrawTable();
+			bool capturing = profiler.IsCapturing();
+			if (ImGui::Checkbox("Stream timings to profile.csv", &capturing))
+			{
+				if (capturing)
+					profiler.StartCapture("profile.csv");
+				else
+					profiler.StopCapture();
+			}
+			ImGui::End();
+
+			ImGui::Render();
+		}
+
+		// Build the frame.
+		profiler.BeginScope("Graph setup");
+		clusteredLights.Update(Camera::Instance(), width, height);
+
+		RenderGraph::TextureDesc sceneDesc;
+		sceneDesc.width = width;
+		sceneDesc.height = height;
+		sceneDesc.samples = hairMode == HairMode::Lines ? sceneSamples : 1;
+		RenderGraph::Handle sceneColor = graph.CreateTexture("SceneColor", sceneDesc);
+		sceneDesc.format = GL_DEPTH_COMPONENT32F;
+		RenderGraph::Handle sceneDepth = graph.CreateTexture("SceneDepth", sceneDesc);
+		RenderGraph::Handle backbuffer;
+		if (window)
+		{
+			backbuffer = graph.ImportBackbuffer(width, height);
+		}
+		else
+		{
+			RenderGraph::TextureDesc outputDesc;
+			outputDesc.width = width;
+			outputDesc.height = height;
+			backbuffer = graph.ImportTexture("Output", frameWriter->GetTexture(), outputDesc, true);
+		}
+
+		RenderGraph::TextureDesc shadowDesc;
+		shadowDesc.width = shadowDesc.height = hairShadow.GetResolution();
+		shadowDesc.format = GL_DEPTH_COMPONENT32F;
+		RenderGraph::Handle hairDepthMap = graph.ImportTexture("HairDepthMap", hairShadow.GetDepthTexture(), shadowDesc);
+		shadowDesc.format = GL_RGBA16F;
+		RenderGraph::Handle hairOpacityMap = graph.ImportTexture("HairOpacityMap", hairShadow.GetOpacityTexture(), shadowDesc);
+
+		RenderGraph::BufferDesc clusterDesc;
+		clusterDesc.size = sizeof(glm::uvec2) * ClusteredLights::s_ClusterCount;
+		RenderGraph::Handle lightClusters = graph.ImportBuffer("LightClusters", clusteredLights.GetClusterBuffer(), clusterDesc);
+		clusterDesc.size = sizeof(uint32_t) * ClusteredLights::s_MaxIndices;
+		RenderGraph::Handle lightIndices = graph.ImportBuffer("LightIndices", clusteredLights.GetIndexBuffer(), clusterDesc);
+
+		graph.AddPass("Light culling",
+			[&](RenderGraph::PassBuilder& pass)
+			{
+				pass.Write(lightClusters, RenderGraph::Access::StorageWrite);
+				pass.Write(lightIndices, RenderGraph::Access::StorageWrite);
+			},
+			[&](RenderGraph&)
+			{
+				light_cull_program.Use();
+				clusteredLights.Cull();
+			});
+
+		if (hairShadowRegenerated)
+		{
+			graph.AddPass("Hair shadow depth",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.DepthAttachment(hairDepthMap, &clearDepth);
+				},
+				[&](RenderGraph&)
+				{
+					hairShadow.Prepare(sun.direction, hairModel, hairSimulationVersion, hairBounds, hair.GetHeader().d_transparency + 0.3f);
+					hairShadow.BeginDepthPass();
+					hair_depth_program.Use();
+					glDrawMeshTasksNV(0, hair.GetHeader().hair_count);
+				});
+
+			graph.AddPass("Hair shadow opacity",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					glm::vec4 noOpacity(0.0f);
+					pass.Read(hairDepthMap, RenderGraph::Access::Sampled);
+					pass.ColorAttachment(hairOpacityMap, &noOpacity);
+				},
+				[&](RenderGraph&)
+				{
+					hairShadow.BeginOpacityPass();
+					hair_opacity_program.Use();
+					glDrawMeshTasksNV(0, hair.GetHeader().hair_count);
+					hairShadow.End(UBOs[0]);
+				});
+		}
+
+		graph.AddPass("Skybox",
+			[&](RenderGraph::PassBuilder& pass)
+			{
+				pass.ColorAttachment(sceneColor, &clearColor);
+				pass.DepthAttachment(sceneDepth, &clearDepth);
+			},
+			[&](RenderGraph&)
+			{
+				// Send cubemap matrix.
+				uploadMatrices(Camera::Instance().GetProjectionMatrix(), Camera::Instance().GetRotationMatrix());
+
+				glDepthFunc(GL_LEQUAL);
+				skybox_program.Use();
+				glDrawMeshTasksNV(0, 1);
+				glDepthFunc(GL_LESS);
+			});
+
+		graph.AddPass("Cubes",
+			[&](RenderGraph::PassBuilder& pass)
+			{
+				pass.ColorAttachment(sceneColor);
+				pass.DepthAttachment(sceneDepth);
+			},
+			[&](RenderGraph&)
+			{
+				// The cube world matrices come from SSBO 13.
+				uploadMatrices(Camera::Instance().GetViewProjection(), glm::mat4(1.0f));
+
+				// One task workgroup per 64 cubes, one mesh workgroup per cube.
+				cube_program.Use();
+				glDrawMeshTasksNV(0, (cubeCount + 63) / 64);
+			});
+
+		if (helmet.GetMeshletCount() > 0 && useVisibilityBuffer)
+		{
+			// Single-sampled: the resolve writes every sample of a pixel with the same shading.
+			RenderGraph::TextureDesc visibilityDesc;
+			visibilityDesc.width = width;
+			visibilityDesc.height = height;
+			visibilityDesc.format = GL_R32UI;
+			RenderGraph::Handle visibility = graph.CreateTexture("Visibility", visibilityDesc);
+			visibilityDesc.format = GL_DEPTH_COMPONENT32F;
+			RenderGraph::Handle visibilityDepth = graph.CreateTexture("VisibilityDepth", visibilityDesc);
+
+			graph.AddPass("Helmet visibility",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					glm::vec4 noGeometry(0.0f);
+					pass.ColorAttachment(visibility, &noGeometry);
+					pass.DepthAttachment(visibilityDepth, &clearDepth);
+				},
+				[&](RenderGraph&)
+				{
+					uploadMatrices(Camera::Instance().GetViewProjection(), helmetModel);
+
+					gltf_visibility_program.Use();
+					glDrawMeshTasksNV(0, helmet.GetMeshletCount());
+				});
+
+			graph.AddPass("Helmet resolve",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.Read(visibility, RenderGraph::Access::Sampled);
+					pass.Read(lightClusters, RenderGraph::Access::StorageRead);
+					pass.Read(lightIndices, RenderGraph::Access::StorageRead);
+					pass.ColorAttachment(sceneColor);
+					pass.DepthAttachment(sceneDepth);
+				},
+				[&, visibility](RenderGraph& resources)
+				{
+					uploadMatrices(Camera::Instance().GetViewProjection(), helmetModel);
+					glBindTextureUnit(3, resources.GetTexture(visibility));
+					gltf_resolve_program.Use();
+					glDrawMeshTasksNV(0, 1);
+				});
+		}
+		else if (helmet.GetMeshletCount() > 0)
+		{
+			graph.AddPass("Helmet forward",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.Read(lightClusters, RenderGraph::Access::StorageRead);
+					pass.Read(lightIndices, RenderGraph::Access::StorageRead);
+					pass.ColorAttachment(sceneColor);
+					pass.DepthAttachment(sceneDepth);
+				},
+				[&](RenderGraph&)
+				{
+					uploadMatrices(Camera::Instance().GetViewProjection(), helmetModel);
+
+					gltf_program.Use();
+					glDrawMeshTasksNV(0, helmet.GetMeshletCount());
+				});
+		}
+
+		graph.AddPass("Hair",
+			[&](RenderGraph::PassBuilder& pass)
+			{
+				pass.Read(hairDepthMap, RenderGraph::Access::Sampled);
+				pass.Read(hairOpacityMap, RenderGraph::Access::Sampled);
+				pass.Read(lightClusters, RenderGraph::Access::StorageRead);
+				pass.Read(lightIndices, RenderGraph::Access::StorageRead);
+				pass.ColorAttachment(sceneColor);
+				pass.DepthAttachment(sceneDepth);
+			},
+			[&](RenderGraph&)
+			{
+				uploadMatrices(Camera::Instance().GetViewProjection(), hairModel);
+
+				hairShadow.Bind();
+				if (hairMode == HairMode::Coverage)
+				{
+					// The antialiasing fringe is translucent, so it must not hide strands behind it.
+					glProgramUniform4f(hair_coverage_program.GetStageID(GL_MESH_SHADER_NV), 1, static_cast<float>(width), static_cast<float>(height), hairWidthPixels, 0.0f);
+					hair_coverage_program.Use();
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, SSBOs[3]);
+					glDepthMask(GL_FALSE);
+					glDrawMeshTasksNV(0, static_cast<GLuint>(ribbonMeshlets.size()));
+					glDepthMask(GL_TRUE);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, SSBOs[1]);
+				}
+				else if (hairMode == HairMode::Ribbons)
+				{
+					glProgramUniform4f(hair_ribbon_program.GetStageID(GL_MESH_SHADER_NV), 1, static_cast<float>(width), static_cast<float>(height), hairWidthPixels, 0.0f);
+					hair_ribbon_program.Use();
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, SSBOs[3]);
+					glDepthMask(GL_FALSE);
+					glDrawMeshTasksNV(0, static_cast<GLuint>(ribbonMeshlets.size()));
+					glDepthMask(GL_TRUE);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, SSBOs[1]);
+				}
+				else
+				{
+					if (hairMeshletColors)
+						hair_debug_program.Use();
+					else
+						hair_program.Use();
+					glDrawMeshTasksNV(0, hair.GetHeader().hair_count);
+				}
+			});
+
+		graph.AddPass("Resolve",
+			[&](RenderGraph::PassBuilder& pass)
+			{
+				pass.Read(sceneColor, RenderGraph::Access::TransferRead);
+				pass.Write(backbuffer, RenderGraph::Access::TransferWrite);
+			},
+			[&](RenderGraph& resources)
+			{
+				glBlitNamedFramebuffer(resources.GetFramebuffer(sceneColor), resources.GetFramebuffer(backbuffer), 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			});
+
+		if (window)
+		{
+			graph.AddPass("UI",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.ColorAttachment(backbuffer);
+				},
+				[&](RenderGraph&)
+				{
+					ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+				});
+		}
+		else if (!options.outputFolder.empty())
+		{
+			graph.AddPass("Readback",
+				[&](RenderGraph::PassBuilder& pass)
+				{
+					pass.Read(backbuffer, RenderGraph::Access::TransferRead);
+					pass.SideEffects();
+				},
+				[&](RenderGraph&)
+				{
+					frameWriter->Capture(frameIndex);
+				});
+		}
+
+		graph.Compile();
+		profiler.EndScope();
+		graph.Execute();
+
+		if (validateLights)
+		{
+			clusteredLights.Validate();
+			validateLights = false;
+		}
+
+		profiler.EndFrame();
+		if (window)
+			glfwSwapBuffers(window);
+
+		heapFrameAllocations = HeapCounter::Get() - heapAllocations;
+		if (frameIndex >= heapWarmupFrames && heapFrameAllocations > 0)
+			++heapAllocatingFrames;
+		++frameIndex;
+	}
+	// The last frame has no next frame start.
+	if (benchmark && frameIndex > 0)
+		benchmark->AddFrameTime(frameIndex - 1, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count());
 
-		ImGui::Render();
+	if (HeapCounter::s_Enabled && frameIndex > heapWarmupFrames)
+		LOG_RUNTIME_INFO("{} of {} frames after warm-up allocated on the heap. Arena high water: frame {} KB, scratch {} KB.", heapAllocatingFrames, frameIndex - heapWarmupFrames,
+			LinearArena::Frame().GetHighWater() / 1024, LinearArena::Scratch().GetHighWater() / 1024);
 
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	profiler.Flush();
+	profiler.StopCapture();
+	frameWriter.reset();
 
-		glfwSwapBuffers(window);
+	// Queued log lines must not land in the middle of a summary on stdout.
+	Logger::Flush();
+	if (benchmark)
+	{
+		int width = options.width, height = options.height;
+		if (window)
+			glfwGetFramebufferSize(window, &width, &height);
+		benchmark->WriteSummary(options.benchmarkSummary, width, height);
 	}
+	if (recorder)
+		recorder->Save(options.recordScript);
 
 	// Clean up.
 	glDeleteBuffers(2, UBOs);
-	glDeleteBuffers(2, SSBOs);
+	glDeleteBuffers(4, SSBOs);
+	glDeleteBuffers(1, &cubeTransforms);
 
-	glfwDestroyWindow(window);
+	if (window)
+		glfwDestroyWindow(window);
+	headless.Destroy();
 	glfwTerminate();
+	Logger::Flush();
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// All material parameters and textures of the scene in one SSBO, indexed per meshlet, so
+// materials never need a rebind or a separate draw.
+//
+// With GL_ARB_bindless_texture every texture slot holds a resident 64-bit handle. Without it the
+// textures are resampled into two texture arrays of s_ArraySize, sRGB for color and linear for
+// data, and a slot holds the layer + 1. Zero means "no texture" either way. Shaders pick the same
+// path through the BINDLESS_MATERIALS global define, which main.cpp sets from IsBindless().
+//
+// Bindings: SSBO 12, texture array fallback on units 7 (color) and 8 (data).
+class MaterialSystem
+{
+public:
+	static constexpr GLuint s_Binding = 12;
+	static constexpr GLuint s_ColorArrayUnit = 7;
+	static constexpr GLuint s_DataArrayUnit = 8;
+	static constexpr GLsizei s_ArraySize = 1024;
+
+	enum Slot : uint32_t
+	{
+		BaseColor = 0,
+		MetallicRoughness = 1,
+		Occlusion = 2,
+		Emissive = 3,
+		SlotCount = 4,
+	};
+
+	// std430 layout shared with the glTF shaders. Before Upload() a texture slot holds the
+	// AddTexture() index in x.
+	struct Material
+	{
+		glm::vec4 baseColorFactor = glm::vec4(1.0f);
+		glm::vec3 emissiveFactor = glm::vec3(0.0f);
+		float occlusionStrength = 1.0f;
+		float metallicFactor = 1.0f;
+		float roughnessFactor = 1.0f;
+		float padding[2] = {};
+		glm::uvec2 textures[SlotCount] = {};
+	};
+	static_assert(sizeof(Material) == 80, "Material must match its std430 layout");
+
+	// `allowBindless` is false when the shaders are SPIR-V, which only has the array path.
+	explicit MaterialSystem(bool allowBindless = true)
+	{
+		m_Bindless = allowBindless && HasGLExtension("GL_ARB_bindless_texture");
+		LOG_RUNTIME_INFO("Materials use {}.", m_Bindless ? "bindless textures" : "texture arrays");
+	}
+
+	~MaterialSystem()
+	{
+		for (GLuint64 handle : m_Handles)
+			glMakeTextureHandleNonResidentARB(handle);
+		for (const Texture& texture : m_Textures)
+			glDeleteTextures(1, &texture.id);
+		glDeleteTextures(2, m_Arrays);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	// Takes ownership of a mipmapped 2D texture; `color` textures are sRGB. Returns the value
+	// for a Material texture slot.
+	uint32_t AddTexture(GLuint texture, bool color)
+	{
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		m_Textures.push_back({ texture, color });
+		return static_cast<uint32_t>(m_Textures.size());
+	}
+
+	uint32_t AddMaterial(const Material& material)
+	{
+		m_Materials.push_back(material);
+		return static_cast<uint32_t>(m_Materials.size() - 1);
+	}
+
+	size_t GetMaterialCount() const
+	{
+		return m_Materials.size();
+	}
+
+	bool IsBindless() const
+	{
+		return m_Bindless;
+	}
+
+	// Resolves texture slots to handles or array layers and uploads the materials. Call once
+	// after every mesh is loaded.
+	void Upload()
+	{
+		std::vector<glm::uvec2> slots(m_Textures.size() + 1, glm::uvec2(0));
+		if (m_Bindless)
+		{
+			for (size_t i = 0; i < m_Textures.size(); ++i)
+			{
+				GLuint64 handle = glGetTextureHandleARB(m_Textures[i].id);
+				glMakeTextureHandleResidentARB(handle);
+				m_Handles.push_back(handle);
+				slots[i + 1] = glm::uvec2(static_cast<uint32_t>(handle), static_cast<uint32_t>(handle >> 32));
+			}
+		}
+		else
+		{
+			BuildArrays(slots);
+		}
+
+		std::vector<Material> materials = m_Materials;
+		if (materials.empty())
+			materials.emplace_back();
+		for (Material& material : materials)
+			for (glm::uvec2& slot : material.textures)
+				slot = slot.x < slots.size() ? slots[slot.x] : glm::uvec2(0);
+
+		glDeleteBuffers(1, &m_Buffer);
+		glCreateBuffers(1, &m_Buffer);
+		glNamedBufferStorage(m_Buffer, sizeof(Material) * materials.size(), materials.data(), GL_NONE);
+		LOG_RUNTIME_INFO("{} materials, {} textures uploaded.", materials.size(), m_Textures.size());
+	}
+
+	void Bind() const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_Binding, m_Buffer);
+		if (!m_Bindless)
+		{
+			glBindTextureUnit(s_ColorArrayUnit, m_Arrays[0]);
+			glBindTextureUnit(s_DataArrayUnit, m_Arrays[1]);
+		}
+	}
+
+private:
+	struct Texture
+	{
+		GLuint id = 0;
+		bool color = false;
+	};
+
+	bool m_Bindless = false;
+	std::vector<Material> m_Materials;
+	std::vector<Texture> m_Textures;
+	std::vector<GLuint64> m_Handles;
+	GLuint m_Arrays[2] = {};
+	GLuint m_Buffer = 0;
+
+	// Texture array fallback: every texture is read back from the largest level that fits,
+	// resampled to s_ArraySize if needed and stored as one layer, then the arrays get mipmaps.
+	void BuildArrays(std::vector<glm::uvec2>& slots)
+	{
+		const GLsizei levels = static_cast<GLsizei>(std::log2(s_ArraySize)) + 1;
+		GLsizei layers[2] = {};
+		for (const Texture& texture : m_Textures)
+			++layers[texture.color ? 0 : 1];
+
+		glDeleteTextures(2, m_Arrays);
+		glCreateTextures(GL_TEXTURE_2D_ARRAY, 2, m_Arrays);
+		for (int i = 0; i < 2; ++i)
+		{
+			glTextureStorage3D(m_Arrays[i], levels, i == 0 ? GL_SRGB8_ALPHA8 : GL_RGBA8, s_ArraySize, s_ArraySize, std::max<GLsizei>(layers[i], 1));
+			glTextureParameteri(m_Arrays[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTextureParameteri(m_Arrays[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTextureParameteri(m_Arrays[i], GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTextureParameteri(m_Arrays[i], GL_TEXTURE_WRAP_T, GL_REPEAT);
+		}
+
+		uint32_t next[2] = {};
+		std::vector<uint32_t> texels, resampled(static_cast<size_t>(s_ArraySize) * s_ArraySize);
+		for (size_t i = 0; i < m_Textures.size(); ++i)
+		{
+			GLuint id = m_Textures[i].id;
+			int array = m_Textures[i].color ? 0 : 1;
+
+			GLint textureLevels = 0, width = 0, height = 0;
+			glGetTextureParameteriv(id, GL_TEXTURE_IMMUTABLE_LEVELS, &textureLevels);
+			glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_WIDTH, &width);
+			glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_HEIGHT, &height);
+			GLint level = 0;
+			while (std::max(width >> level, height >> level) > s_ArraySize && level + 1 < std::max(textureLevels, 1))
+				++level;
+			GLsizei levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+
+			// sRGB texels come back encoded, as the color array stores them.
+			texels.resize(static_cast<size_t>(levelWidth) * levelHeight);
+			glGetTextureImage(id, level, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(texels.size() * sizeof(uint32_t)), texels.data());
+			const uint32_t* source = texels.data();
+			if (levelWidth != s_ArraySize || levelHeight != s_ArraySize)
+			{
+				for (GLsizei y = 0; y < s_ArraySize; ++y)
+					for (GLsizei x = 0; x < s_ArraySize; ++x)
+						resampled[static_cast<size_t>(y) * s_ArraySize + x] = texels[static_cast<size_t>(y * levelHeight / s_ArraySize) * levelWidth + x * levelWidth / s_ArraySize];
+				source = resampled.data();
+			}
+
+			glTextureSubImage3D(m_Arrays[array], 0, 0, 0, next[array], s_ArraySize, s_ArraySize, 1, GL_RGBA, GL_UNSIGNED_BYTE, source);
+			slots[i + 1] = glm::uvec2(++next[array], 0);
+		}
+		glGenerateTextureMipmap(m_Arrays[0]);
+		glGenerateTextureMipmap(m_Arrays[1]);
+	}
+};
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A static triangle mesh loaded from glTF and split into meshlets for the mesh shader.
+//
+// All primitives of the default scene are flattened into one vertex and index list in world space
+// of the file. Meshlets hold up to s_MaxVertices unique vertices and s_MaxTriangles triangles;
+// triangles store three local vertex indices packed into one uint (8 bits each).
+//
+// Every glTF material becomes a MaterialSystem material and meshlets never mix materials, so a
+// meshlet carries its material index and the whole mesh is still a single draw. Images are
+// cooked to BC7 on first use, sRGB or linear depending on the material slot that uses them.
+//
+// The visibility buffer identifies a triangle as ((meshlet << s_TriangleBits) | triangle) + 1, so
+// zero means "no geometry". s_MaxTriangles must stay below 1 << s_TriangleBits.
+class Mesh
+{
+public:
+	static constexpr uint32_t s_MaxVertices = 64;
+	static constexpr uint32_t s_MaxTriangles = 124;
+	static constexpr uint32_t s_TriangleBits = 7;
+
+	// Matches the std430 layout in base.mesh: uv packed into the w components.
+	struct Vertex
+	{
+		glm::vec4 positionU;
+		glm::vec4 normalV;
+	};
+
+	struct Meshlet
+	{
+		uint32_t vertexOffset = 0;
+		uint32_t vertexCount = 0;
+		uint32_t triangleOffset = 0;
+		uint32_t triangleCount = 0;
+		uint32_t material = 0;
+	};
+
+	~Mesh()
+	{
+		glDeleteBuffers(4, m_Buffers);
+	}
+
+	// Materials and textures go to `materials`, which must be uploaded once all meshes are loaded.
+	bool Load(const std::filesystem::path& path, MaterialSystem& materials)
+	{
+		tinygltf::Model model;
+		tinygltf::TinyGLTF loader;
+		std::string error, warning;
+
+		// Images with a compressed copy of the same content are not decoded.
+		ImageSources sources{ path };
+		loader.SetImageLoader(LoadImage, &sources);
+
+		bool loaded = path.extension() == ".glb"
+			? loader.LoadBinaryFromFile(&model, &error, &warning, path.string())
+			: loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
+		if (!warning.empty())
+			LOG_RUNTIME_WARN("glTF {}: {}", path.string(), warning);
+		if (!loaded)
+		{
+			LOG_RUNTIME_ERROR("Cannot load glTF {}: {}", path.string(), error);
+			return false;
+		}
+
+		m_Materials = LoadMaterials(model, sources, materials);
+
+		int scene = model.defaultScene >= 0 ? model.defaultScene : 0;
+		if (scene < static_cast<int>(model.scenes.size()))
+			for (int node : model.scenes[scene].nodes)
+				LoadNode(model, node, glm::mat4(1.0f));
+
+		if (m_Indices.empty())
+		{
+			LOG_RUNTIME_ERROR("glTF {} has no triangles.", path.string());
+			return false;
+		}
+
+		BuildMeshlets();
+		Upload();
+
+		LOG_RUNTIME_INFO("glTF \"{}\" loaded: {} vertices, {} triangles, {} meshlets.", path.string(), m_Vertices.size(), m_Indices.size() / 3, m_Meshlets.size());
+		return true;
+	}
+
+	// Vertices, meshlets, meshlet vertex indices and packed triangles at bindings first..first + 3.
+	void Bind(GLuint first) const
+	{
+		glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, first, 4, m_Buffers);
+	}
+
+	GLuint GetMeshletCount() const
+	{
+		return static_cast<GLuint>(m_Meshlets.size());
+	}
+
+	size_t GetTriangleCount() const
+	{
+		return m_Indices.size() / 3;
+	}
+
+	// Bounding sphere in model space (xyz: center, w: radius).
+	const glm::vec4& GetBounds() const
+	{
+		return m_Bounds;
+	}
+
+private:
+	std::vector<Vertex> m_Vertices;
+	std::vector<uint32_t> m_Indices;
+	std::vector<uint32_t> m_TriangleMaterials;
+	// MaterialSystem index of every glTF material, the last entry is the default material.
+	std::vector<uint32_t> m_Materials;
+	std::vector<Meshlet> m_Meshlets;
+	std::vector<uint32_t> m_MeshletVertices;
+	std::vector<uint32_t> m_MeshletTriangles;
+	glm::vec4 m_Bounds = glm::vec4(0.0f);
+
+	GLuint m_Buffers[4] = {};
+
+	void LoadNode(const tinygltf::Model& model, int index, const glm::mat4& parent)
+	{
+		const tinygltf::Node& node = model.nodes[index];
+
+		glm::mat4 local(1.0f);
+		if (node.matrix.size() == 16)
+		{
+			for (int i = 0; i < 16; ++i)
+				local[i / 4][i % 4] = static_cast<float>(node.matrix[i]);
+		}
+		else
+		{
+			if (node.translation.size() == 3)
+				local = glm::translate(local, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+			if (node.rotation.size() == 4)
+				local *= glm::toMat4(glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+			if (node.scale.size() == 3)
+				local = glm::scale(local, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+		}
+		glm::mat4 world = parent * local;
+
+		if (node.mesh >= 0)
+			for (const tinygltf::Primitive& primitive : model.meshes[node.mesh].primitives)
+				LoadPrimitive(model, primitive, world);
+
+		for (int child : node.children)
+			LoadNode(model, child, world);
+	}
+
+	void LoadPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const glm::mat4& world)
+	{
+		auto position = primitive.attributes.find("POSITION");
+		if (primitive.mode != TINYGLTF_MODE_TRIANGLES || position == primitive.attributes.end())
+			return;
+
+		bool hasMaterial = primitive.material >= 0 && static_cast<size_t>(primitive.material) + 1 < m_Materials.size();
+		uint32_t material = m_Materials[hasMaterial ? primitive.material : m_Materials.size() - 1];
+		size_t firstIndex = m_Indices.size();
+		auto normal = primitive.attributes.find("NORMAL");
+		auto texcoord = primitive.attributes.find("TEXCOORD_0");
+		const tinygltf::Accessor& positions = model.accessors[position->second];
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+
+		uint32_t base = static_cast<uint32_t>(m_Vertices.size());
+		for (size_t i = 0; i < positions.count; ++i)
+		{
+			glm::vec3 p = glm::vec3(world * glm::vec4(ReadFloats<3>(model, positions, i), 1.0f));
+			glm::vec3 n = normal != primitive.attributes.end() ? glm::normalize(normalMatrix * ReadFloats<3>(model, model.accessors[normal->second], i)) : glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::vec2 uv = texcoord != primitive.attributes.end() ? ReadFloats<2>(model, model.accessors[texcoord->second], i) : glm::vec2(0.0f);
+			m_Vertices.push_back({ glm::vec4(p, uv.x), glm::vec4(n, uv.y) });
+		}
+
+		if (primitive.indices < 0)
+		{
+			for (uint32_t i = 0; i < positions.count; ++i)
+				m_Indices.push_back(base + i);
+			m_TriangleMaterials.resize(m_Indices.size() / 3, material);
+			return;
+		}
+
+		const tinygltf::Accessor& indices = model.accessors[primitive.indices];
+		const tinygltf::BufferView& view = model.bufferViews[indices.bufferView];
+		const unsigned char* data = model.buffers[view.buffer].data.data() + view.byteOffset + indices.byteOffset;
+		int stride = indices.ByteStride(view);
+		for (size_t i = 0; i < indices.count; ++i)
+		{
+			const unsigned char* element = data + i * stride;
+			uint32_t value = 0;
+			switch (indices.componentType)
+			{
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:  value = *element; break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, element, sizeof(v)); value = v; break; }
+			default:                                     memcpy(&value, element, sizeof(value)); break;
+			}
+			m_Indices.push_back(base + value);
+		}
+		m_Indices.resize(firstIndex + (m_Indices.size() - firstIndex) / 3 * 3);
+		m_TriangleMaterials.resize(m_Indices.size() / 3, material);
+	}
+
+	// Float attributes only, which covers positions, normals and non-quantized texcoords.
+	template<int N>
+	static glm::vec<N, float> ReadFloats(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t index)
+	{
+		glm::vec<N, float> value(0.0f);
+		if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || index >= accessor.count)
+			return value;
+
+		const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+		const unsigned char* data = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset + index * accessor.ByteStride(view);
+		memcpy(&value[0], data, sizeof(float) * N);
+		return value;
+	}
+
+	// Greedy in index order: a meshlet is closed when the next triangle would overflow it or uses
+	// another material.
+	void BuildMeshlets()
+	{
+		std::vector<uint32_t> localIndex(m_Vertices.size(), ~0u);
+		Meshlet meshlet;
+
+		auto flush = [&]()
+		{
+			if (meshlet.triangleCount == 0)
+				return;
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+				localIndex[m_MeshletVertices[meshlet.vertexOffset + i]] = ~0u;
+			m_Meshlets.push_back(meshlet);
+			meshlet = Meshlet();
+			meshlet.vertexOffset = static_cast<uint32_t>(m_MeshletVertices.size());
+			meshlet.triangleOffset = static_cast<uint32_t>(m_MeshletTriangles.size());
+		};
+
+		for (size_t t = 0; t + 2 < m_Indices.size(); t += 3)
+		{
+			uint32_t newVertices = 0;
+			for (int k = 0; k < 3; ++k)
+				newVertices += localIndex[m_Indices[t + k]] == ~0u ? 1 : 0;
+			uint32_t material = m_TriangleMaterials[t / 3];
+			if (meshlet.vertexCount + newVertices > s_MaxVertices || meshlet.triangleCount + 1 > s_MaxTriangles
+				|| (meshlet.triangleCount > 0 && meshlet.material != material))
+				flush();
+			meshlet.material = material;
+
+			uint32_t packed = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t vertex = m_Indices[t + k];
+				if (localIndex[vertex] == ~0u)
+				{
+					localIndex[vertex] = meshlet.vertexCount++;
+					m_MeshletVertices.push_back(vertex);
+				}
+				packed |= localIndex[vertex] << (8 * k);
+			}
+			m_MeshletTriangles.push_back(packed);
+			++meshlet.triangleCount;
+		}
+		flush();
+
+		glm::vec3 minimum(m_Vertices.front().positionU), maximum = minimum;
+		for (const Vertex& vertex : m_Vertices)
+		{
+			minimum = glm::min(minimum, glm::vec3(vertex.positionU));
+			maximum = glm::max(maximum, glm::vec3(vertex.positionU));
+		}
+		glm::vec3 center = (minimum + maximum) * 0.5f;
+		m_Bounds = glm::vec4(center, glm::length(maximum - center));
+	}
+
+	// The glTF file and a hash of the encoded bytes of each of its images, filled in by LoadImage().
+	// Images are usually separate files, so the .gltf's own time stamp says nothing about them.
+	struct ImageSources
+	{
+		const std::filesystem::path& path;
+		std::vector<uint64_t> hashes;
+	};
+
+	// Keyed on the image content, so an edited image gets a new entry and an old one is never stale.
+	static std::filesystem::path GetImageCachePath(const ImageSources& sources, int image)
+	{
+		uint64_t hash = image < static_cast<int>(sources.hashes.size()) ? sources.hashes[image] : 0;
+		return TextureCache::GetPath((sources.path.stem().string() + "_image" + std::to_string(image)).c_str(), hash);
+	}
+
+	// tinygltf image loader: leaves images with a cache entry empty, decodes the rest.
+	static bool LoadImage(tinygltf::Image* image, const int index, std::string* error, std::string* warning, int width, int height, const unsigned char* bytes, int size, void* user)
+	{
+		ImageSources& sources = *static_cast<ImageSources*>(user);
+		if (index >= static_cast<int>(sources.hashes.size()))
+			sources.hashes.resize(index + 1, 0);
+		sources.hashes[index] = ProgramCache::HashBytes(bytes, static_cast<size_t>(size));
+
+		std::error_code existsError;
+		if (std::filesystem::exists(GetImageCachePath(sources, index), existsError))
+			return true;
+		return tinygltf::LoadImageData(image, index, error, warning, width, height, bytes, size, nullptr);
+	}
+
+	// Adds every glTF material, plus a default one for primitives without a material.
+	static std::vector<uint32_t> LoadMaterials(const tinygltf::Model& model, const ImageSources& sources, MaterialSystem& materials)
+	{
+		std::vector<uint32_t> images(model.images.size(), 0);
+		std::vector<uint32_t> indices;
+		for (const tinygltf::Material& source : model.materials)
+		{
+			const tinygltf::PbrMetallicRoughness& pbr = source.pbrMetallicRoughness;
+			MaterialSystem::Material material;
+			if (pbr.baseColorFactor.size() == 4)
+				material.baseColorFactor = glm::vec4(pbr.baseColorFactor[0], pbr.baseColorFactor[1], pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+			if (source.emissiveFactor.size() == 3)
+				material.emissiveFactor = glm::vec3(source.emissiveFactor[0], source.emissiveFactor[1], source.emissiveFactor[2]);
+			material.occlusionStrength = static_cast<float>(source.occlusionTexture.strength);
+			material.metallicFactor = static_cast<float>(pbr.metallicFactor);
+			material.roughnessFactor = static_cast<float>(pbr.roughnessFactor);
+
+			material.textures[MaterialSystem::BaseColor].x = LoadTexture(model, pbr.baseColorTexture.index, true, sources, materials, images);
+			material.textures[MaterialSystem::MetallicRoughness].x = LoadTexture(model, pbr.metallicRoughnessTexture.index, false, sources, materials, images);
+			material.textures[MaterialSystem::Occlusion].x = LoadTexture(model, source.occlusionTexture.index, false, sources, materials, images);
+			material.textures[MaterialSystem::Emissive].x = LoadTexture(model, source.emissiveTexture.index, true, sources, materials, images);
+			indices.push_back(materials.AddMaterial(material));
+		}
+
+		// Untextured dielectric.
+		MaterialSystem::Material fallback;
+		fallback.metallicFactor = 0.0f;
+		fallback.roughnessFactor = 0.5f;
+		indices.push_back(materials.AddMaterial(fallback));
+		return indices;
+	}
+
+	// Texture slot value of a glTF texture, 0 when there is none. Every image is uploaded once,
+	// with the color space of the first slot that uses it, and cooked to BC7.
+	static uint32_t LoadTexture(const tinygltf::Model& model, int index, bool color, const ImageSources& sources, MaterialSystem& materials, std::vector<uint32_t>& images)
+	{
+		if (index < 0 || index >= static_cast<int>(model.textures.size()))
+			return 0;
+		int source = model.textures[index].source;
+		if (source < 0 || source >= static_cast<int>(images.size()))
+			return 0;
+		if (images[source] != 0)
+			return images[source];
+
+		std::filesystem::path cached = GetImageCachePath(sources, source);
+		const tinygltf::Image& image = model.images[source];
+		GLuint texture = 0;
+		if (image.image.empty())
+		{
+			if ((texture = TextureCache::Load(cached)) == 0)
+			{
+				// The image was skipped for nothing; drop the entry so the next run cooks it again.
+				std::filesystem::remove(cached);
+				return 0;
+			}
+		}
+		else if (image.component == 4 && image.bits == 8)
+		{
+			glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+			GLsizei levels = static_cast<GLsizei>(std::floor(std::log2(std::max(image.width, image.height)))) + 1;
+			glTextureStorage2D(texture, levels, color ? GL_SRGB8_ALPHA8 : GL_RGBA8, image.width, image.height);
+			glTextureSubImage2D(texture, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.image.data());
+			glGenerateTextureMipmap(texture);
+
+			GLuint compressed = 0;
+			if (TextureCache::Cook(texture, color ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM, cached) && (compressed = TextureCache::Load(cached)) != 0)
+			{
+				glDeleteTextures(1, &texture);
+				texture = compressed;
+			}
+		}
+		else
+		{
+			LOG_RUNTIME_WARN("glTF {}: image {} is not 8-bit RGBA, skipped.", sources.path.string(), source);
+			return 0;
+		}
+		return images[source] = materials.AddTexture(texture, color);
+	}
+
+	void Upload()
+	{
+		glCreateBuffers(4, m_Buffers);
+		glNamedBufferStorage(m_Buffers[0], sizeof(Vertex) * m_Vertices.size(), m_Vertices.data(), GL_NONE);
+		glNamedBufferStorage(m_Buffers[1], sizeof(Meshlet) * m_Meshlets.size(), m_Meshlets.data(), GL_NONE);
+		glNamedBufferStorage(m_Buffers[2], sizeof(uint32_t) * m_MeshletVertices.size(), m_MeshletVertices.data(), GL_NONE);
+		glNamedBufferStorage(m_Buffers[3], sizeof(uint32_t) * m_MeshletTriangles.size(), m_MeshletTriangles.data(), GL_NONE);
+	}
+};
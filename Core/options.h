@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+enum class HairMode
+{
+	Lines,
+	Coverage,
+	Ribbons,
+};
+
+inline const char* GetHairModeName(HairMode mode)
+{
+	static const char* const names[] = { "lines", "coverage", "ribbons" };
+	return names[static_cast<int>(mode)];
+}
+
+// How the GL context is created.
+enum class GLProfile
+{
+	Debug,       // Debug context with throttled debug output, see GLDebugOutput.
+	Production,  // KHR_no_error context: no error checks in the driver and no debug output.
+};
+
+// Command line options.
+//
+//   --headless            Render offscreen without a window (surfaceless EGL on Linux).
+//   --size WxH            Render resolution, 1920x1440 by default.
+//   --frames N            Number of frames to render in headless mode, 1 by default.
+//   --output DIR          Write every rendered frame to DIR as frame_NNNNN.ppm.
+//   --profile-csv FILE    Stream profiler timings to FILE from the first frame.
+//   --benchmark           Play a camera path with input disabled, print a JSON summary and exit.
+//   --script FILE         Benchmark keyframes, see benchmark.h. Without one a default orbit of
+//                         --frames frames (600 if not given) is played.
+//   --summary FILE        Write the benchmark summary to FILE instead of stdout. Benchmark runs
+//                         log to stderr either way.
+//   --record FILE         Record the interactive camera and model as a benchmark script.
+//   --hair MODE           Hair rendering: lines (8x MSAA, default), coverage (analytic antialiasing
+//                         of pixel-wide strands) or ribbons (per-point thickness); the last two
+//                         render the scene at 1x.
+//   --spirv               Build programs from the SPIR-V of Tools/ShaderCompiler where it is up to
+//                         date. Materials then use texture arrays, SPIR-V has no bindless textures.
+//                         Saves the shader defines of this device for the next Core build.
+//   --threads N           Job system threads including the main thread, all hardware threads by
+//                         default.
+//   --job-scaling         Log how the CPU load stages scale from 1 to every hardware thread.
+//   --cubes N             Cubes in the grid drawn next to the models, each a scene node; 64 by
+//                         default. Tens of thousands stress the scene update.
+//   --shaders SOURCE      Read shaders from the copies embedded at build time (embedded, default in
+//                         Release) or from Assets/Shaders/ (disk, default in Debug).
+//   --log MODE            Write log messages on a background thread (async, default in Release) or
+//                         on the logging thread (sync, default in Debug).
+//   --log-file FILE       Also write the log to FILE.
+//   --gl-profile PROFILE  Create a debug context with debug output (debug, default in Debug) or a
+//                         no-error context without it (production, default in Release).
+struct Options
+{
+	bool headless = false;
+	int width = 1920;
+	int height = 1440;
+	int frames = 1;
+	std::filesystem::path outputFolder;
+	std::filesystem::path profileCsv;
+	bool benchmark = false;
+	bool framesGiven = false;
+	std::filesystem::path benchmarkScript;
+	std::filesystem::path benchmarkSummary;
+	std::filesystem::path recordScript;
+	HairMode hairMode = HairMode::Lines;
+	bool spirv = false;
+	unsigned threads = 0;
+	bool jobScaling = false;
+	unsigned cubes = 64;
+#if defined(NDEBUG)
+	bool embeddedShaders = true;
+	bool asyncLog = true;
+	GLProfile glProfile = GLProfile::Production;
+#else
+	bool embeddedShaders = false;
+	bool asyncLog = false;
+	GLProfile glProfile = GLProfile::Debug;
+#endif
+	std::filesystem::path logFile;
+
+	static Options Parse(int argc, char* argv[])
+	{
+		Options options;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+			bool hasValue = i + 1 < argc;
+
+			if (strcmp(arg, "--headless") == 0)
+			{
+				options.headless = true;
+			}
+			else if (strcmp(arg, "--size") == 0 && hasValue)
+			{
+				int width = 0, height = 0;
+				if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+				{
+					options.width = width;
+					options.height = height;
+				}
+				else
+				{
+					LOG_RUNTIME_WARN("Invalid --size \"{}\", expected WxH.", argv[i]);
+				}
+			}
+			else if (strcmp(arg, "--frames") == 0 && hasValue)
+			{
+				options.frames = std::max(1, atoi(argv[++i]));
+				options.framesGiven = true;
+			}
+			else if (strcmp(arg, "--output") == 0 && hasValue)
+			{
+				options.outputFolder = argv[++i];
+			}
+			else if (strcmp(arg, "--profile-csv") == 0 && hasValue)
+			{
+				options.profileCsv = argv[++i];
+			}
+			else if (strcmp(arg, "--benchmark") == 0)
+			{
+				options.benchmark = true;
+			}
+			else if (strcmp(arg, "--script") == 0 && hasValue)
+			{
+				options.benchmarkScript = argv[++i];
+			}
+			else if (strcmp(arg, "--summary") == 0 && hasValue)
+			{
+				options.benchmarkSummary = argv[++i];
+			}
+			else if (strcmp(arg, "--record") == 0 && hasValue)
+			{
+				options.recordScript = argv[++i];
+			}
+			else if (strcmp(arg, "--hair") == 0 && hasValue)
+			{
+				const char* mode = argv[++i];
+				if (strcmp(mode, GetHairModeName(HairMode::Lines)) == 0)
+					options.hairMode = HairMode::Lines;
+				else if (strcmp(mode, GetHairModeName(HairMode::Coverage)) == 0)
+					options.hairMode = HairMode::Coverage;
+				else if (strcmp(mode, GetHairModeName(HairMode::Ribbons)) == 0)
+					options.hairMode = HairMode::Ribbons;
+				else
+					LOG_RUNTIME_WARN("Invalid --hair \"{}\", expected lines, coverage or ribbons.", mode);
+			}
+			else if (strcmp(arg, "--spirv") == 0)
+			{
+				options.spirv = true;
+			}
+			else if (strcmp(arg, "--threads") == 0 && hasValue)
+			{
+				options.threads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+			}
+			else if (strcmp(arg, "--cubes") == 0 && hasValue)
+			{
+				options.cubes = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+			}
+			else if (strcmp(arg, "--job-scaling") == 0)
+			{
+				options.jobScaling = true;
+			}
+			else if (strcmp(arg, "--shaders") == 0 && hasValue)
+			{
+				const char* source = argv[++i];
+				if (strcmp(source, "embedded") == 0 || strcmp(source, "disk") == 0)
+					options.embeddedShaders = strcmp(source, "embedded") == 0;
+				else
+					LOG_RUNTIME_WARN("Invalid --shaders \"{}\", expected embedded or disk.", source);
+			}
+			else if (strcmp(arg, "--log") == 0 && hasValue)
+			{
+				const char* mode = argv[++i];
+				if (strcmp(mode, "async") == 0 || strcmp(mode, "sync") == 0)
+					options.asyncLog = strcmp(mode, "async") == 0;
+				else
+					LOG_RUNTIME_WARN("Invalid --log \"{}\", expected async or sync.", mode);
+			}
+			else if (strcmp(arg, "--log-file") == 0 && hasValue)
+			{
+				options.logFile = argv[++i];
+			}
+			else if (strcmp(arg, "--gl-profile") == 0 && hasValue)
+			{
+				const char* profile = argv[++i];
+				if (strcmp(profile, "debug") == 0 || strcmp(profile, "production") == 0)
+					options.glProfile = strcmp(profile, "debug") == 0 ? GLProfile::Debug : GLProfile::Production;
+				else
+					LOG_RUNTIME_WARN("Invalid --gl-profile \"{}\", expected debug or production.", profile);
+			}
+			else
+			{
+				LOG_RUNTIME_WARN("Unknown command line argument \"{}\".", arg);
+			}
+		}
+		return options;
+	}
+};
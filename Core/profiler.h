@@ -0,0 +1,275 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Scoped CPU and GPU timers.
+//
+// GPU scopes are bracketed with GL_TIMESTAMP queries so they can nest. Every frame in flight
+// owns its own slice of the query pool, and a frame's results are only read back
+// s_FramesInFlight frames later, once the last query reports GL_QUERY_RESULT_AVAILABLE, so
+// reading timings never stalls the pipeline. A frame whose results are still not ready is
+// dropped rather than waited on.
+class Profiler
+{
+public:
+	static constexpr uint32_t s_FramesInFlight = 4;
+
+	struct ScopeResult
+	{
+		const char* name;
+		uint32_t depth;
+		double cpuMs;
+		double gpuMs;
+	};
+
+	// Called with every frame that is read back, in frame order.
+	using FrameCallback = std::function<void(uint64_t frame, const std::vector<ScopeResult>& results)>;
+
+	static Profiler& Instance()
+	{
+		static Profiler* instance = new Profiler();
+		return *instance;
+	}
+
+	void BeginFrame()
+	{
+		Frame& frame = m_Frames[m_FrameIndex % s_FramesInFlight];
+		if (frame.pending)
+			Collect(frame);
+
+		frame.scopes.clear();
+		frame.usedQueries = 0;
+		frame.pending = false;
+		frame.index = m_FrameIndex;
+
+		BeginScope("Frame");
+	}
+
+	void EndFrame()
+	{
+		EndScope();
+		m_Frames[m_FrameIndex % s_FramesInFlight].pending = true;
+		++m_FrameIndex;
+	}
+
+	// Reads back every frame still in flight, e.g. before exiting.
+	void Flush()
+	{
+		glFinish();
+		for (uint32_t i = 0; i < s_FramesInFlight; ++i)
+		{
+			Frame& frame = m_Frames[(m_FrameIndex + i) % s_FramesInFlight];
+			if (frame.pending)
+				Collect(frame);
+			frame.pending = false;
+		}
+	}
+
+	// Names must outlive the frame's read back, string literals are expected.
+	void BeginScope(const char* name)
+	{
+		Frame& frame = m_Frames[m_FrameIndex % s_FramesInFlight];
+
+		Scope scope;
+		scope.name = name;
+		scope.depth = static_cast<uint32_t>(m_Stack.size());
+		scope.beginQuery = AcquireQuery(frame);
+		glQueryCounter(frame.queries[scope.beginQuery], GL_TIMESTAMP);
+		scope.cpuBegin = std::chrono::high_resolution_clock::now();
+
+		m_Stack.push_back(static_cast<uint32_t>(frame.scopes.size()));
+		frame.scopes.push_back(scope);
+	}
+
+	void EndScope()
+	{
+		Frame& frame = m_Frames[m_FrameIndex % s_FramesInFlight];
+
+		Scope& scope = frame.scopes[m_Stack.back()];
+		m_Stack.pop_back();
+		scope.cpuEnd = std::chrono::high_resolution_clock::now();
+		scope.endQuery = AcquireQuery(frame);
+		glQueryCounter(frame.queries[scope.endQuery], GL_TIMESTAMP);
+	}
+
+	// Results of the most recent frame that has been read back.
+	const std::vector<ScopeResult>& GetResults() const
+	{
+		return m_Results;
+	}
+
+	// Last measured GPU time of a scope, kept across frames where it did not run.
+	float GetLastGpuTime(const char* name) const
+	{
+		auto it = m_LastGpuTimes.find(std::string_view(name));
+		return it != m_LastGpuTimes.end() ? it->second : 0.0f;
+	}
+
+	void SetFrameCallback(const FrameCallback& callback)
+	{
+		m_FrameCallback = callback;
+	}
+
+	bool IsCapturing() const
+	{
+		return m_Csv.is_open();
+	}
+
+	// Streams every read back frame to a CSV file: frame, scope, depth, cpu_ms, gpu_ms.
+	bool StartCapture(const std::filesystem::path& path)
+	{
+		m_Csv.open(path, std::ios::out | std::ios::trunc);
+		if (!m_Csv.is_open())
+		{
+			LOG_RUNTIME_ERROR("Cannot open profiler capture file {}", path.string());
+			return false;
+		}
+		m_Csv << "frame,scope,depth,cpu_ms,gpu_ms\n";
+		LOG_RUNTIME_INFO("Profiler capture started: {}", path.string());
+		return true;
+	}
+
+	void StopCapture()
+	{
+		if (m_Csv.is_open())
+		{
+			m_Csv.close();
+			LOG_RUNTIME_INFO("Profiler capture stopped.");
+		}
+	}
+
+	void DrawTable() const
+	{
+		if (!ImGui::BeginTable("Scopes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+			return;
+
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("CPU ms");
+		ImGui::TableSetupColumn("GPU ms");
+		ImGui::TableHeadersRow();
+		for (const ScopeResult& result : m_Results)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Indent(result.depth * 16.0f + 1.0f);
+			ImGui::TextUnformatted(result.name);
+			ImGui::Unindent(result.depth * 16.0f + 1.0f);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.cpuMs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", result.gpuMs);
+		}
+		ImGui::EndTable();
+
+		if (m_DroppedFrames)
+			ImGui::Text("%llu frames dropped (results not ready)", static_cast<unsigned long long>(m_DroppedFrames));
+	}
+
+private:
+	struct Scope
+	{
+		const char* name = nullptr;
+		uint32_t depth = 0;
+		uint32_t beginQuery = 0, endQuery = 0;
+		std::chrono::high_resolution_clock::time_point cpuBegin, cpuEnd;
+	};
+
+	struct Frame
+	{
+		std::vector<GLuint> queries;
+		uint32_t usedQueries = 0;
+		std::vector<Scope> scopes;
+		uint64_t index = 0;
+		bool pending = false;
+	};
+
+	Frame m_Frames[s_FramesInFlight];
+	std::vector<uint32_t> m_Stack;
+	uint64_t m_FrameIndex = 0;
+	uint64_t m_DroppedFrames = 0;
+
+	std::vector<ScopeResult> m_Results;
+	// Ordered for the lookup by string_view, which does not build a std::string per call.
+	std::map<std::string, float, std::less<>> m_LastGpuTimes;
+	std::ofstream m_Csv;
+	FrameCallback m_FrameCallback;
+
+	Profiler() = default;
+
+	uint32_t AcquireQuery(Frame& frame)
+	{
+		if (frame.usedQueries == frame.queries.size())
+		{
+			size_t grow = frame.queries.empty() ? 32 : frame.queries.size();
+			frame.queries.resize(frame.queries.size() + grow);
+			glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(grow), frame.queries.data() + frame.usedQueries);
+		}
+		return frame.usedQueries++;
+	}
+
+	void Collect(const Frame& frame)
+	{
+		if (frame.usedQueries == 0)
+			return;
+
+		// Queries complete in order, so the last one being ready means the whole frame is.
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			++m_DroppedFrames;
+			return;
+		}
+
+		m_Results.clear();
+		for (const Scope& scope : frame.scopes)
+		{
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[scope.endQuery], GL_QUERY_RESULT, &end);
+
+			ScopeResult result;
+			result.name = scope.name;
+			result.depth = scope.depth;
+			result.cpuMs = std::chrono::duration<double, std::milli>(scope.cpuEnd - scope.cpuBegin).count();
+			result.gpuMs = static_cast<double>(end - begin) * 1e-6;
+			m_Results.push_back(result);
+			auto last = m_LastGpuTimes.find(std::string_view(scope.name));
+			if (last == m_LastGpuTimes.end())
+				last = m_LastGpuTimes.emplace(scope.name, 0.0f).first;
+			last->second = static_cast<float>(result.gpuMs);
+
+			if (m_Csv.is_open())
+				m_Csv << frame.index << ',' << scope.name << ',' << scope.depth << ',' << result.cpuMs << ',' << result.gpuMs << '\n';
+		}
+
+		if (m_FrameCallback)
+			m_FrameCallback(frame.index, m_Results);
+	}
+};
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name)
+	{
+		Profiler::Instance().BeginScope(name);
+	}
+
+	~ProfileScope()
+	{
+		Profiler::Instance().EndScope();
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
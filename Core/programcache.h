@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only memory mapping of a whole file, empty when the file cannot be mapped.
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::filesystem::path& path)
+	{
+#if defined(_WIN32)
+		m_File = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER size;
+		if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+			return;
+		m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_Mapping == nullptr)
+			return;
+		m_Data = MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+		m_Size = m_Data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		struct stat status;
+		if (fd >= 0 && fstat(fd, &status) == 0 && status.st_size > 0)
+		{
+			void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED)
+			{
+				m_Data = data;
+				m_Size = static_cast<size_t>(status.st_size);
+			}
+		}
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	~MappedFile()
+	{
+#if defined(_WIN32)
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+#else
+		if (m_Data)
+			munmap(m_Data, m_Size);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* GetData() const
+	{
+		return static_cast<const char*>(m_Data);
+	}
+
+	size_t GetSize() const
+	{
+		return m_Size;
+	}
+
+private:
+	void* m_Data = nullptr;
+	size_t m_Size = 0;
+#if defined(_WIN32)
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = nullptr;
+#endif
+};
+
+// Program binaries on disk, addressed by content.
+//
+// The key hashes the program sources together with GL_VENDOR, GL_RENDERER and GL_VERSION, so an
+// edit, a new GPU or a driver update each miss instead of handing the driver a binary it will
+// reject. An entry is a Header, which also records the binary format, followed by the
+// glGetProgramBinary() blob, loaded straight from a memory mapping.
+//
+// Loading an entry counts as a use and bumps its write time; Store() evicts the least recently
+// used entries once the folder exceeds s_Budget.
+class ProgramCache
+{
+public:
+	static constexpr uintmax_t s_Budget = 64ull * 1024 * 1024;
+
+	// FNV-1a over raw bytes, chained through `hash` to key on several inputs. Named apart from
+	// Hash() so a C string cannot bind to it and have `hash` taken for its size.
+	static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static uint64_t Hash(const std::string& text, uint64_t hash = 14695981039346656037ull)
+	{
+		// The length keeps "ab" + "c" and "a" + "bc" apart.
+		uint64_t size = text.size();
+		return HashBytes(text.data(), text.size(), HashBytes(&size, sizeof(size), hash));
+	}
+
+	// Key for a program; the driver strings are hashed in first. Needs a current context.
+	static uint64_t GetKey(const std::vector<std::string>& sources)
+	{
+		static const uint64_t driver = []()
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+				hash = Hash(std::string(reinterpret_cast<const char*>(glGetString(name))), hash);
+			return hash;
+		}();
+
+		uint64_t hash = driver;
+		for (const std::string& source : sources)
+			hash = Hash(source, hash);
+		return hash;
+	}
+
+	// `name` only makes the folder readable, the key alone identifies the entry.
+	static std::filesystem::path GetPath(const std::string& name, uint64_t key)
+	{
+		char hash[24];
+		snprintf(hash, sizeof(hash), "_%016llx.bin", static_cast<unsigned long long>(key));
+		std::filesystem::path path = s_Folder / name;
+		path += hash;
+		return path;
+	}
+
+	// Creates a program from the entry, 0 on a miss. An entry the driver rejects is deleted.
+	static GLuint Load(const std::filesystem::path& path, uint64_t key)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(path, error))
+			return 0;
+
+		GLuint program = 0;
+		{
+			MappedFile file(path);
+			Header header;
+			if (file.GetSize() < sizeof(Header))
+				return 0;
+			memcpy(&header, file.GetData(), sizeof(Header));
+			if (memcmp(header.magic, s_Magic, sizeof(s_Magic)) != 0 || header.key != key || sizeof(Header) + header.length > file.GetSize())
+			{
+				LOG_RUNTIME_WARN("{} is not a cached program for this key.", path.string());
+				return 0;
+			}
+
+			program = glCreateProgram();
+			glProgramBinary(program, header.format, file.GetData() + sizeof(Header), static_cast<GLsizei>(header.length));
+		}
+
+		GLint linked; glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			LOG_RUNTIME_WARN("The driver rejected the cached program {}.", path.filename().string());
+			glDeleteProgram(program);
+			std::filesystem::remove(path, error);
+			return 0;
+		}
+
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+		return program;
+	}
+
+	static void Store(const std::filesystem::path& path, uint64_t key, GLuint program)
+	{
+		Header header = {};
+		memcpy(header.magic, s_Magic, sizeof(s_Magic));
+		header.key = key;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		ScratchScope scratch;
+		std::pmr::vector<char> binary(static_cast<size_t>(length), scratch);
+		glGetProgramBinary(program, length, &length, &header.format, binary.data());
+		header.length = static_cast<uint32_t>(length);
+
+		if (!std::filesystem::exists(s_Folder))
+			std::filesystem::create_directory(s_Folder);
+		std::ofstream file(path, std::ios::out | std::ios::trunc | std::ios::binary);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(binary.data(), header.length);
+		file.close();
+
+		Trim();
+	}
+
+private:
+	inline static const std::filesystem::path s_Folder = "Assets/ShaderCache/";
+	static constexpr char s_Magic[4] = { 'I', 'V', 'P', 'B' };
+
+	struct Header
+	{
+		char magic[4];
+		GLenum format;
+		uint64_t key;
+		uint32_t length;
+		uint32_t padding;
+	};
+	static_assert(sizeof(Header) == 24, "Program cache header is 24 bytes");
+
+	// Deletes the oldest entries until the folder fits in s_Budget.
+	static void Trim()
+	{
+		struct Entry
+		{
+			std::filesystem::path path;
+			std::filesystem::file_time_type time;
+			uintmax_t size;
+		};
+
+		std::error_code error;
+		std::vector<Entry> entries;
+		uintmax_t total = 0;
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(s_Folder, error))
+		{
+			if (!entry.is_regular_file(error) || entry.path().extension() != ".bin")
+				continue;
+			entries.push_back({ entry.path(), entry.last_write_time(error), entry.file_size(error) });
+			total += entries.back().size;
+		}
+		if (total <= s_Budget)
+			return;
+
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+		for (const Entry& entry : entries)
+		{
+			if (total <= s_Budget)
+				break;
+			if (std::filesystem::remove(entry.path, error))
+			{
+				total -= entry.size;
+				LOG_RUNTIME_INFO("Evicted {} from the program cache.", entry.path.filename().string());
+			}
+		}
+	}
+};
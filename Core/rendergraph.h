@@ -0,0 +1,788 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A small per-frame render graph.
+//
+// Each frame passes are added with the resources they read and write. Compile() culls the
+// passes whose results never reach an output, orders the rest by their dependencies, computes
+// the lifetime of every transient resource so that transients with disjoint lifetimes share one
+// GL object, and works out the minimal glMemoryBarrier bits each pass needs. Execute() binds framebuffers and runs the
+// surviving passes. Physical textures and buffers are pooled across frames.
+//
+// The per-frame passes, resources and execute lambdas live in LinearArena::Frame(), so building
+// and compiling a frame does not touch the heap once the pools are warm.
+class RenderGraph
+{
+	struct Pass;
+
+public:
+	using Handle = uint32_t;
+	static constexpr Handle InvalidHandle = ~0u;
+
+	enum class Access
+	{
+		ColorAttachment,
+		DepthAttachment,
+		Sampled,        // texture(), texelFetch()
+		ImageLoad,
+		ImageStore,
+		StorageRead,
+		StorageWrite,
+		Uniform,
+		Indirect,
+		TransferRead,   // Blits, readbacks, glGet*Image
+		TransferWrite,  // glClear*, glCopy*, glNamedBufferSubData
+	};
+
+	struct TextureDesc
+	{
+		GLenum format = GL_RGBA8;
+		GLsizei width = 0;
+		GLsizei height = 0;
+		GLsizei samples = 1;
+		GLsizei levels = 1;
+
+		bool operator==(const TextureDesc& other) const
+		{
+			return format == other.format && width == other.width && height == other.height && samples == other.samples && levels == other.levels;
+		}
+	};
+
+	struct BufferDesc
+	{
+		GLsizeiptr size = 0;
+	};
+
+	struct Stats
+	{
+		uint32_t passes = 0;
+		uint32_t culledPasses = 0;
+		uint32_t barriers = 0;
+		uint32_t transientResources = 0;
+		uint32_t physicalResources = 0;
+		size_t transientBytes = 0;  // What the transients would take without aliasing.
+		size_t physicalBytes = 0;   // What they take in this frame's pool.
+	};
+
+	class PassBuilder
+	{
+	public:
+		void Read(Handle resource, Access access)
+		{
+			m_Pass.reads.push_back({ resource, access });
+		}
+
+		void Write(Handle resource, Access access)
+		{
+			m_Pass.writes.push_back({ resource, access });
+		}
+
+		// Without a clear value the previous contents are loaded, which makes this a read too.
+		void ColorAttachment(Handle resource, const glm::vec4* clear = nullptr)
+		{
+			Attachment attachment = { resource, clear != nullptr };
+			if (clear)
+				attachment.clearColor = *clear;
+			else
+				Read(resource, Access::ColorAttachment);
+			m_Pass.colors.push_back(attachment);
+			Write(resource, Access::ColorAttachment);
+		}
+
+		void DepthAttachment(Handle resource, const float* clear = nullptr)
+		{
+			Attachment attachment = { resource, clear != nullptr };
+			if (clear)
+				attachment.clearDepth = *clear;
+			else
+				Read(resource, Access::DepthAttachment);
+			m_Pass.depth = attachment;
+			Write(resource, Access::DepthAttachment);
+		}
+
+		// The pass is never culled, e.g. it writes to the CPU or keeps persistent state.
+		void SideEffects()
+		{
+			m_Pass.sideEffects = true;
+		}
+
+	private:
+		friend class RenderGraph;
+		Pass& m_Pass;
+		PassBuilder(Pass& pass) : m_Pass(pass) {}
+	};
+
+	~RenderGraph()
+	{
+		ReleaseFramebuffers();
+		for (Physical& physical : m_PhysicalTextures)
+			glDeleteTextures(1, &physical.id);
+		for (Physical& physical : m_PhysicalBuffers)
+			glDeleteBuffers(1, &physical.id);
+	}
+
+	// Starts a new frame; handles from the previous frame become invalid. Call before the frame
+	// arena is reset, the graph lets go of its memory there.
+	// Pass and resource names are used as profiler scopes and labels and must be string literals.
+	void Reset()
+	{
+		m_Resources = std::pmr::vector<Resource>(m_Arena);
+		m_Passes = std::pmr::vector<Pass>(m_Arena);
+		m_Order = std::pmr::vector<uint32_t>(m_Arena);
+		++m_Frame;
+	}
+
+	Handle CreateTexture(const char* name, const TextureDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.texture = desc;
+		return AddResource(resource);
+	}
+
+	Handle CreateBuffer(const char* name, const BufferDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isBuffer = true;
+		resource.buffer = desc;
+		return AddResource(resource);
+	}
+
+	// Persistent textures owned elsewhere. Outputs keep their writers alive.
+	Handle ImportTexture(const char* name, GLuint id, const TextureDesc& desc, bool output = false)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.texture = desc;
+		resource.imported = true;
+		resource.output = output;
+		resource.id = id;
+		return AddResource(resource);
+	}
+
+	Handle ImportBuffer(const char* name, GLuint id, const BufferDesc& desc, bool output = false)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.isBuffer = true;
+		resource.buffer = desc;
+		resource.imported = true;
+		resource.output = output;
+		resource.id = id;
+		return AddResource(resource);
+	}
+
+	// The default framebuffer, always an output.
+	Handle ImportBackbuffer(GLsizei width, GLsizei height)
+	{
+		Resource resource;
+		resource.name = "Backbuffer";
+		resource.texture.width = width;
+		resource.texture.height = height;
+		resource.imported = true;
+		resource.output = true;
+		resource.backbuffer = true;
+		return AddResource(resource);
+	}
+
+	// `setup(PassBuilder&)` runs right away, `execute(RenderGraph&)` is copied into the frame
+	// arena and runs in Execute(). Its captures are never destroyed, so it may only hold
+	// references and plain values.
+	template<typename Setup, typename Execute>
+	void AddPass(const char* name, Setup&& setup, Execute&& execute)
+	{
+		using Callable = std::decay_t<Execute>;
+		static_assert(std::is_trivially_destructible_v<Callable>, "Render graph passes cannot own their captures");
+
+		Pass& pass = m_Passes.emplace_back(m_Arena);
+		pass.name = name;
+		pass.execute = new (m_Arena->allocate(sizeof(Callable), alignof(Callable))) Callable(std::forward<Execute>(execute));
+		pass.invoke = [](void* callable, RenderGraph& graph) { (*static_cast<Callable*>(callable))(graph); };
+		PassBuilder builder(pass);
+		setup(builder);
+	}
+
+	void Compile()
+	{
+		m_Stats = Stats();
+		m_Stats.passes = static_cast<uint32_t>(m_Passes.size());
+
+		BuildDependencies();
+		Cull();
+		Sort();
+		ComputeLifetimes();
+		AssignPhysicalResources();
+		ComputeBarriers();
+	}
+
+	void Execute()
+	{
+		for (uint32_t index : m_Order)
+		{
+			Pass& pass = m_Passes[index];
+			PROFILE_SCOPE(pass.name);
+
+			if (pass.barrier)
+				glMemoryBarrier(pass.barrier);
+
+			if (!pass.colors.empty() || pass.depth.resource != InvalidHandle)
+				BeginRendering(pass);
+
+			pass.invoke(pass.execute, *this);
+		}
+	}
+
+	GLuint GetTexture(Handle handle) const
+	{
+		return m_Resources[handle].id;
+	}
+
+	GLuint GetBuffer(Handle handle) const
+	{
+		return m_Resources[handle].id;
+	}
+
+	const TextureDesc& GetTextureDesc(Handle handle) const
+	{
+		return m_Resources[handle].texture;
+	}
+
+	// A framebuffer with the texture as its only attachment, for blits and readbacks.
+	GLuint GetFramebuffer(Handle handle)
+	{
+		const Resource& resource = m_Resources[handle];
+		if (resource.backbuffer)
+			return 0;
+
+		bool depth = IsDepthFormat(resource.texture.format);
+		const GLuint key[] = { depth ? 0u : resource.id, depth ? resource.id : 0u };
+		return FindFramebuffer(key, 2);
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+	static size_t GetBytesPerPixel(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8:                   return 1;
+		case GL_RG8: case GL_R16F:    return 2;
+		case GL_RGBA8: case GL_SRGB8_ALPHA8: case GL_R32F: case GL_R32UI: case GL_RG16F:
+		case GL_R11F_G11F_B10F: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+		case GL_RGBA16F: case GL_RG32F: return 8;
+		case GL_RGBA32F:              return 16;
+		default:                      return 4;
+		}
+	}
+
+private:
+	struct Attachment
+	{
+		Handle resource = InvalidHandle;
+		bool clear = false;
+		glm::vec4 clearColor = glm::vec4(0.0f);
+		float clearDepth = 1.0f;
+	};
+
+	struct Pass
+	{
+		explicit Pass(std::pmr::memory_resource* arena) : reads(arena), writes(arena), colors(arena), dependencies(arena) {}
+
+		const char* name = nullptr;
+		std::pmr::vector<std::pair<Handle, Access>> reads, writes;
+		std::pmr::vector<Attachment> colors;
+		Attachment depth;
+		bool sideEffects = false;
+		void* execute = nullptr;
+		void (*invoke)(void* execute, RenderGraph& graph) = nullptr;
+
+		std::pmr::vector<uint32_t> dependencies;
+		bool culled = true;
+		GLbitfield barrier = 0;
+	};
+
+	struct Resource
+	{
+		const char* name = nullptr;
+		bool isBuffer = false;
+		bool imported = false;
+		bool output = false;
+		bool backbuffer = false;
+		TextureDesc texture;
+		BufferDesc buffer;
+		GLuint id = 0;
+
+		uint32_t firstUse = ~0u, lastUse = 0;  // Positions in m_Order.
+	};
+
+	struct Physical
+	{
+		GLuint id = 0;
+		TextureDesc texture;
+		BufferDesc buffer;
+		uint64_t lastFrame = 0;
+		uint32_t busyUntil = 0;
+		bool assigned = false;
+	};
+
+	struct FramebufferEntry
+	{
+		std::vector<GLuint> attachments;  // Color ids, then the depth id last.
+		GLuint id = 0;
+	};
+
+	std::pmr::memory_resource* m_Arena = &LinearArena::Frame();
+	std::pmr::vector<Resource> m_Resources{ m_Arena };
+	std::pmr::vector<Pass> m_Passes{ m_Arena };
+	std::pmr::vector<uint32_t> m_Order{ m_Arena };
+	std::vector<Physical> m_PhysicalTextures, m_PhysicalBuffers;
+	std::vector<FramebufferEntry> m_Framebuffers;
+	uint64_t m_Frame = 0;
+	Stats m_Stats;
+
+	// Pooled resources unused for this many frames are released.
+	static constexpr uint64_t s_MaxIdleFrames = 3;
+
+	Handle AddResource(const Resource& resource)
+	{
+		m_Resources.push_back(resource);
+		return static_cast<Handle>(m_Resources.size() - 1);
+	}
+
+	static bool IsDepthFormat(GLenum format)
+	{
+		return format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	static bool IsIntegerFormat(GLenum format)
+	{
+		return format == GL_R32UI || format == GL_RG32UI || format == GL_RGBA32UI || format == GL_R16UI || format == GL_R8UI;
+	}
+
+	static bool IsIncoherentWrite(Access access)
+	{
+		return access == Access::ImageStore || access == Access::StorageWrite;
+	}
+
+	// The barrier bit that makes incoherent shader writes visible to this kind of access.
+	static GLbitfield GetBarrierBit(Access access, bool buffer)
+	{
+		switch (access)
+		{
+		case Access::ColorAttachment:
+		case Access::DepthAttachment: return GL_FRAMEBUFFER_BARRIER_BIT;
+		case Access::Sampled:         return buffer ? GL_SHADER_STORAGE_BARRIER_BIT : GL_TEXTURE_FETCH_BARRIER_BIT;
+		case Access::ImageLoad:
+		case Access::ImageStore:      return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+		case Access::StorageRead:
+		case Access::StorageWrite:    return GL_SHADER_STORAGE_BARRIER_BIT;
+		case Access::Uniform:         return GL_UNIFORM_BARRIER_BIT;
+		case Access::Indirect:        return GL_COMMAND_BARRIER_BIT;
+		case Access::TransferRead:
+		case Access::TransferWrite:   return buffer ? GL_BUFFER_UPDATE_BARRIER_BIT : (GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+		}
+		return GL_ALL_BARRIER_BITS;
+	}
+
+	size_t GetSize(const Resource& resource) const
+	{
+		if (resource.isBuffer)
+			return static_cast<size_t>(resource.buffer.size);
+		return GetBytesPerPixel(resource.texture.format) * resource.texture.width * resource.texture.height * resource.texture.samples;
+	}
+
+	// Read-after-write, write-after-read and write-after-write edges, in submission order.
+	void BuildDependencies()
+	{
+		ScratchScope scratch;
+		std::pmr::vector<uint32_t> lastWriter(m_Resources.size(), ~0u, scratch);
+		std::pmr::vector<std::pmr::vector<uint32_t>> readersSinceWrite(m_Resources.size(), scratch);
+
+		for (uint32_t i = 0; i < m_Passes.size(); ++i)
+		{
+			Pass& pass = m_Passes[i];
+			for (auto& [resource, access] : pass.reads)
+			{
+				if (lastWriter[resource] != ~0u && lastWriter[resource] != i)
+					pass.dependencies.push_back(lastWriter[resource]);
+			}
+			for (auto& [resource, access] : pass.writes)
+			{
+				if (lastWriter[resource] != ~0u && lastWriter[resource] != i)
+					pass.dependencies.push_back(lastWriter[resource]);
+				for (uint32_t reader : readersSinceWrite[resource])
+					if (reader != i)
+						pass.dependencies.push_back(reader);
+			}
+
+			for (auto& [resource, access] : pass.reads)
+				readersSinceWrite[resource].push_back(i);
+			for (auto& [resource, access] : pass.writes)
+			{
+				lastWriter[resource] = i;
+				readersSinceWrite[resource].clear();
+			}
+		}
+	}
+
+	// Keeps passes with side effects or output writes, and everything they depend on.
+	void Cull()
+	{
+		ScratchScope scratch;
+		std::pmr::vector<uint32_t> stack(scratch);
+		for (uint32_t i = 0; i < m_Passes.size(); ++i)
+		{
+			Pass& pass = m_Passes[i];
+			bool root = pass.sideEffects;
+			for (auto& [resource, access] : pass.writes)
+				root = root || m_Resources[resource].output;
+			if (root)
+				stack.push_back(i);
+		}
+
+		while (!stack.empty())
+		{
+			uint32_t index = stack.back();
+			stack.pop_back();
+			Pass& pass = m_Passes[index];
+			if (!pass.culled)
+				continue;
+			pass.culled = false;
+			for (uint32_t dependency : pass.dependencies)
+				if (m_Passes[dependency].culled)
+					stack.push_back(dependency);
+		}
+	}
+
+	// Topological sort of the surviving passes (Kahn's algorithm). Of the passes that are ready,
+	// the one consuming the most recently scheduled result runs first, which keeps producers next
+	// to their consumers and transient lifetimes short; ties keep submission order. Edges come
+	// from declaration order per resource, so the graph has no cycles.
+	void Sort()
+	{
+		ScratchScope scratch;
+		std::pmr::vector<uint32_t> pending(m_Passes.size(), 0, scratch);   // Unscheduled dependencies.
+		std::pmr::vector<int64_t> latest(m_Passes.size(), -1, scratch);    // Position of the last scheduled one.
+		std::pmr::vector<std::pmr::vector<uint32_t>> dependents(m_Passes.size(), scratch);
+		std::pmr::vector<uint32_t> ready(scratch);
+
+		for (uint32_t i = 0; i < m_Passes.size(); ++i)
+		{
+			if (m_Passes[i].culled)
+			{
+				++m_Stats.culledPasses;
+				continue;
+			}
+			for (uint32_t dependency : m_Passes[i].dependencies)
+			{
+				++pending[i];
+				dependents[dependency].push_back(i);
+			}
+			if (pending[i] == 0)
+				ready.push_back(i);
+		}
+
+		m_Order.clear();
+		while (!ready.empty())
+		{
+			auto next = ready.begin();
+			for (auto it = ready.begin(); it != ready.end(); ++it)
+				if (latest[*it] > latest[*next] || (latest[*it] == latest[*next] && *it < *next))
+					next = it;
+			const uint32_t index = *next;
+			ready.erase(next);
+
+			const int64_t position = static_cast<int64_t>(m_Order.size());
+			m_Order.push_back(index);
+			for (uint32_t dependent : dependents[index])
+			{
+				latest[dependent] = position;
+				if (--pending[dependent] == 0)
+					ready.push_back(dependent);
+			}
+		}
+	}
+
+	void ComputeLifetimes()
+	{
+		for (uint32_t position = 0; position < m_Order.size(); ++position)
+		{
+			const Pass& pass = m_Passes[m_Order[position]];
+			auto touch = [&](Handle handle)
+			{
+				Resource& resource = m_Resources[handle];
+				resource.firstUse = std::min(resource.firstUse, position);
+				resource.lastUse = std::max(resource.lastUse, position);
+			};
+			for (auto& [resource, access] : pass.reads)
+				touch(resource);
+			for (auto& [resource, access] : pass.writes)
+				touch(resource);
+		}
+	}
+
+	// Greedy interval assignment: a transient reuses any pooled object with a matching
+	// description whose previous user in this frame has already finished.
+	void AssignPhysicalResources()
+	{
+		for (Physical& physical : m_PhysicalTextures)
+			physical.assigned = false;
+		for (Physical& physical : m_PhysicalBuffers)
+			physical.assigned = false;
+
+		ScratchScope scratch;
+		std::pmr::vector<Handle> transients(scratch);
+		for (Handle handle = 0; handle < m_Resources.size(); ++handle)
+		{
+			const Resource& resource = m_Resources[handle];
+			if (!resource.imported && resource.firstUse != ~0u)
+				transients.push_back(handle);
+		}
+		std::sort(transients.begin(), transients.end(), [this](Handle a, Handle b) { return m_Resources[a].firstUse < m_Resources[b].firstUse; });
+
+		for (Handle handle : transients)
+		{
+			Resource& resource = m_Resources[handle];
+			std::vector<Physical>& pool = resource.isBuffer ? m_PhysicalBuffers : m_PhysicalTextures;
+
+			Physical* match = nullptr;
+			for (Physical& physical : pool)
+			{
+				bool compatible = resource.isBuffer ? physical.buffer.size >= resource.buffer.size : physical.texture == resource.texture;
+				if (compatible && (!physical.assigned || physical.busyUntil < resource.firstUse))
+				{
+					match = &physical;
+					break;
+				}
+			}
+
+			if (!match)
+			{
+				pool.push_back(CreatePhysical(resource));
+				match = &pool.back();
+				m_Stats.physicalBytes += GetSize(resource);
+			}
+			else if (!match->assigned)
+			{
+				m_Stats.physicalBytes += resource.isBuffer ? static_cast<size_t>(match->buffer.size) : GetSize(resource);
+			}
+
+			if (!match->assigned)
+				++m_Stats.physicalResources;
+			match->assigned = true;
+			match->busyUntil = resource.lastUse;
+			match->lastFrame = m_Frame;
+			resource.id = match->id;
+
+			++m_Stats.transientResources;
+			m_Stats.transientBytes += GetSize(resource);
+		}
+
+		ReleaseIdle(m_PhysicalTextures, false);
+		ReleaseIdle(m_PhysicalBuffers, true);
+	}
+
+	Physical CreatePhysical(const Resource& resource)
+	{
+		Physical physical;
+		if (resource.isBuffer)
+		{
+			physical.buffer = resource.buffer;
+			glCreateBuffers(1, &physical.id);
+			glNamedBufferStorage(physical.id, resource.buffer.size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+		else
+		{
+			const TextureDesc& desc = resource.texture;
+			physical.texture = desc;
+			if (desc.samples > 1)
+			{
+				glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &physical.id);
+				glTextureStorage2DMultisample(physical.id, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+			}
+			else
+			{
+				glCreateTextures(GL_TEXTURE_2D, 1, &physical.id);
+				glTextureStorage2D(physical.id, desc.levels, desc.format, desc.width, desc.height);
+				glTextureParameteri(physical.id, GL_TEXTURE_MIN_FILTER, desc.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+				glTextureParameteri(physical.id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTextureParameteri(physical.id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			}
+		}
+		glObjectLabel(resource.isBuffer ? GL_BUFFER : GL_TEXTURE, physical.id, -1, resource.name);
+		return physical;
+	}
+
+	void ReleaseIdle(std::vector<Physical>& pool, bool buffers)
+	{
+		for (size_t i = 0; i < pool.size();)
+		{
+			if (m_Frame - pool[i].lastFrame > s_MaxIdleFrames)
+			{
+				if (buffers)
+				{
+					glDeleteBuffers(1, &pool[i].id);
+				}
+				else
+				{
+					ReleaseFramebuffers(pool[i].id);
+					glDeleteTextures(1, &pool[i].id);
+				}
+				pool.erase(pool.begin() + i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
+	// A resource written by shader stores needs a barrier before its next access; a barrier
+	// issued for one resource makes every earlier write of that kind visible, so track per
+	// resource which bits have already been issued since its last incoherent write.
+	void ComputeBarriers()
+	{
+		ScratchScope scratch;
+		std::pmr::vector<bool> dirty(m_Resources.size(), false, scratch);
+		std::pmr::vector<GLbitfield> visible(m_Resources.size(), 0, scratch);
+
+		for (uint32_t index : m_Order)
+		{
+			Pass& pass = m_Passes[index];
+			auto require = [&](Handle handle, Access access)
+			{
+				GLbitfield bit = GetBarrierBit(access, m_Resources[handle].isBuffer);
+				if (dirty[handle] && (visible[handle] & bit) != bit)
+					pass.barrier |= bit;
+			};
+			for (auto& [resource, access] : pass.reads)
+				require(resource, access);
+			for (auto& [resource, access] : pass.writes)
+				require(resource, access);
+
+			if (pass.barrier)
+			{
+				++m_Stats.barriers;
+				for (Handle handle = 0; handle < m_Resources.size(); ++handle)
+					if (dirty[handle])
+						visible[handle] |= pass.barrier;
+			}
+
+			for (auto& [resource, access] : pass.writes)
+			{
+				if (IsIncoherentWrite(access))
+				{
+					dirty[resource] = true;
+					visible[resource] = 0;
+				}
+			}
+		}
+	}
+
+	// `attachments` holds `count` ids: the colors, then the depth id last.
+	GLuint FindFramebuffer(const GLuint* attachments, size_t count)
+	{
+		for (const FramebufferEntry& entry : m_Framebuffers)
+			if (std::equal(entry.attachments.begin(), entry.attachments.end(), attachments, attachments + count))
+				return entry.id;
+
+		FramebufferEntry entry;
+		entry.attachments.assign(attachments, attachments + count);
+		glCreateFramebuffers(1, &entry.id);
+
+		size_t colorCount = count - 1;
+		ScratchScope scratch;
+		std::pmr::vector<GLenum> drawBuffers(scratch);
+		for (size_t i = 0; i < colorCount; ++i)
+		{
+			if (attachments[i] == 0)
+				continue;
+			glNamedFramebufferTexture(entry.id, static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i), attachments[i], 0);
+			drawBuffers.push_back(static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i));
+		}
+		if (attachments[colorCount] != 0)
+			glNamedFramebufferTexture(entry.id, GL_DEPTH_ATTACHMENT, attachments[colorCount], 0);
+
+		if (drawBuffers.empty())
+		{
+			glNamedFramebufferDrawBuffer(entry.id, GL_NONE);
+			glNamedFramebufferReadBuffer(entry.id, GL_NONE);
+		}
+		else
+		{
+			glNamedFramebufferDrawBuffers(entry.id, static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+			glNamedFramebufferReadBuffer(entry.id, drawBuffers.front());
+		}
+
+		if (glCheckNamedFramebufferStatus(entry.id, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			LOG_RUNTIME_ERROR("Render graph framebuffer is incomplete.");
+
+		m_Framebuffers.push_back(entry);
+		return entry.id;
+	}
+
+	void ReleaseFramebuffers()
+	{
+		for (FramebufferEntry& entry : m_Framebuffers)
+			glDeleteFramebuffers(1, &entry.id);
+		m_Framebuffers.clear();
+	}
+
+	// Only the framebuffers that reference `texture`; the rest stay cached.
+	void ReleaseFramebuffers(GLuint texture)
+	{
+		auto references = [texture](const FramebufferEntry& entry) { return std::find(entry.attachments.begin(), entry.attachments.end(), texture) != entry.attachments.end(); };
+		for (const FramebufferEntry& entry : m_Framebuffers)
+			if (references(entry))
+				glDeleteFramebuffers(1, &entry.id);
+		m_Framebuffers.erase(std::remove_if(m_Framebuffers.begin(), m_Framebuffers.end(), references), m_Framebuffers.end());
+	}
+
+	void BeginRendering(const Pass& pass)
+	{
+		const Resource& first = m_Resources[pass.colors.empty() ? pass.depth.resource : pass.colors.front().resource];
+
+		GLuint framebuffer = 0;
+		if (!first.backbuffer)
+		{
+			ScratchScope scratch;
+			std::pmr::vector<GLuint> attachments(scratch);
+			for (const Attachment& color : pass.colors)
+				attachments.push_back(m_Resources[color.resource].id);
+			attachments.push_back(pass.depth.resource != InvalidHandle ? m_Resources[pass.depth.resource].id : 0);
+			framebuffer = FindFramebuffer(attachments.data(), attachments.size());
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, first.texture.width, first.texture.height);
+
+		for (size_t i = 0; i < pass.colors.size(); ++i)
+		{
+			if (!pass.colors[i].clear)
+				continue;
+			// Integer targets take the clear value converted, e.g. an ID buffer cleared to 0.
+			if (IsIntegerFormat(m_Resources[pass.colors[i].resource].texture.format))
+			{
+				glm::uvec4 clearValue(pass.colors[i].clearColor);
+				glClearNamedFramebufferuiv(framebuffer, GL_COLOR, static_cast<GLint>(i), &clearValue[0]);
+			}
+			else
+			{
+				glClearNamedFramebufferfv(framebuffer, GL_COLOR, static_cast<GLint>(i), &pass.colors[i].clearColor[0]);
+			}
+		}
+		if (pass.depth.resource != InvalidHandle && pass.depth.clear)
+			glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &pass.depth.clearDepth);
+	}
+};
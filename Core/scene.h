@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SCENE_SSE 1
+#endif
+
+// Transform hierarchy stored as a structure of arrays.
+//
+// A node is an index into parallel arrays of local position, rotation and scale and the local
+// and world matrices, so an update streams through each array once. Setters only mark the node
+// dirty; Update() recomputes the local matrix of dirty nodes and the world matrix of every node
+// that is dirty or has a changed parent, one hierarchy level at a time since a level needs its
+// parents' world matrices. Each level counts its dirty and changed nodes, so a level with nothing
+// to recompute or reset is skipped outright; large levels are split over the job system, small
+// ones run inline, so a steady scene does not allocate job state every frame. World matrices are
+// contiguous in creation order, ready to upload as they are.
+class Scene
+{
+public:
+	using Node = uint32_t;
+	static constexpr Node InvalidNode = ~0u;
+
+	// Nodes per job in Update(); a level with fewer runs on the calling thread.
+	static constexpr size_t s_Grain = 4096;
+
+	Node Create(Node parent = InvalidNode)
+	{
+		Node node = static_cast<Node>(m_Parent.size());
+		uint32_t depth = parent == InvalidNode ? 0 : m_Depth[parent] + 1;
+		m_Parent.push_back(parent);
+		m_Depth.push_back(depth);
+		m_Position.push_back(glm::vec3(0.0f));
+		m_Rotation.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		m_Scale.push_back(glm::vec3(1.0f));
+		m_Local.push_back(glm::mat4(1.0f));
+		m_World.push_back(glm::mat4(1.0f));
+		m_Dirty.push_back(1);
+		m_Changed.push_back(0);
+
+		if (m_Levels.size() <= depth)
+		{
+			m_Levels.resize(depth + 1);
+			m_LevelDirty.resize(depth + 1, 0);
+			m_LevelChanged.resize(depth + 1, 0);
+		}
+		m_Levels[depth].push_back(node);
+		++m_LevelDirty[depth];
+		return node;
+	}
+
+	size_t GetCount() const
+	{
+		return m_Parent.size();
+	}
+
+	void SetPosition(Node node, const glm::vec3& position)
+	{
+		if (m_Position[node] != position)
+		{
+			m_Position[node] = position;
+			MarkDirty(node);
+		}
+	}
+
+	void SetRotation(Node node, const glm::quat& rotation)
+	{
+		if (m_Rotation[node] != rotation)
+		{
+			m_Rotation[node] = rotation;
+			MarkDirty(node);
+		}
+	}
+
+	void SetScale(Node node, const glm::vec3& scale)
+	{
+		if (m_Scale[node] != scale)
+		{
+			m_Scale[node] = scale;
+			MarkDirty(node);
+		}
+	}
+
+	// Valid after Update().
+	const glm::mat4& GetWorld(Node node) const
+	{
+		return m_World[node];
+	}
+
+	// World matrices of every node, indexed by Node.
+	const glm::mat4* GetWorldMatrices() const
+	{
+		return m_World.data();
+	}
+
+	// Whether the world matrix of a node in [first, first + count) changed in the last Update().
+	bool HasChanged(Node first, size_t count = 1) const
+	{
+		for (size_t i = first; i < first + count; ++i)
+			if (m_Changed[i])
+				return true;
+		return false;
+	}
+
+	void Update()
+	{
+		JobSystem& jobs = JobSystem::Get();
+		for (size_t depth = 0; depth < m_Levels.size(); ++depth)
+		{
+			// Nothing to recompute, and no changed flags left from the last update to clear.
+			bool parentsChanged = depth > 0 && m_LevelChanged[depth - 1] != 0;
+			if (m_LevelDirty[depth] == 0 && !parentsChanged && m_LevelChanged[depth] == 0)
+				continue;
+
+			const std::vector<Node>& level = m_Levels[depth];
+			if (level.size() <= s_Grain)
+				m_LevelChanged[depth] = UpdateNodes(level.data(), level.data() + level.size());
+			else
+			{
+				std::atomic<size_t> changed{ 0 };
+				jobs.Wait(jobs.ParallelFor(level.size(), s_Grain, [this, &level, &changed](size_t begin, size_t end)
+				{
+					changed.fetch_add(UpdateNodes(level.data() + begin, level.data() + end), std::memory_order_relaxed);
+				}));
+				m_LevelChanged[depth] = changed.load(std::memory_order_relaxed);
+			}
+			m_LevelDirty[depth] = 0;
+		}
+	}
+
+private:
+	std::vector<Node> m_Parent;
+	std::vector<uint32_t> m_Depth;
+	std::vector<glm::vec3> m_Position;
+	std::vector<glm::quat> m_Rotation;
+	std::vector<glm::vec3> m_Scale;
+	std::vector<glm::mat4> m_Local;
+	std::vector<glm::mat4> m_World;
+	std::vector<uint8_t> m_Dirty;    // Local transform set since the last update.
+	std::vector<uint8_t> m_Changed;  // World matrix recomputed by the last update.
+	std::vector<std::vector<Node>> m_Levels;
+	std::vector<size_t> m_LevelDirty;   // Dirty nodes per level.
+	std::vector<size_t> m_LevelChanged; // Nodes per level whose world matrix the last update recomputed.
+
+	void MarkDirty(Node node)
+	{
+		if (!m_Dirty[node])
+		{
+			m_Dirty[node] = 1;
+			++m_LevelDirty[m_Depth[node]];
+		}
+	}
+
+	// Returns how many of the nodes changed.
+	size_t UpdateNodes(const Node* begin, const Node* end)
+	{
+		size_t count = 0;
+		for (const Node* it = begin; it != end; ++it)
+		{
+			Node node = *it;
+			Node parent = m_Parent[node];
+			bool changed = m_Dirty[node] || (parent != InvalidNode && m_Changed[parent]);
+			if (m_Dirty[node])
+				m_Local[node] = Compose(m_Position[node], m_Rotation[node], m_Scale[node]);
+			if (changed)
+			{
+				if (parent == InvalidNode)
+					m_World[node] = m_Local[node];
+				else
+					Multiply(m_World[parent], m_Local[node], m_World[node]);
+			}
+			m_Changed[node] = changed;
+			m_Dirty[node] = 0;
+			count += changed;
+		}
+		return count;
+	}
+
+	// translate(position) * toMat4(rotation) * scale(scale), without the three full products.
+	static glm::mat4 Compose(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		glm::mat3 basis = glm::mat3_cast(rotation);
+		glm::mat4 local(1.0f);
+		local[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+		local[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+		local[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+		local[3] = glm::vec4(position, 1.0f);
+		return local;
+	}
+
+	// out = a * b, column by column as four multiply-adds over the columns of a.
+	static void Multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+	{
+#if defined(SCENE_SSE)
+		const float* lhs = &a[0][0];
+		const float* rhs = &b[0][0];
+		float* result = &out[0][0];
+		__m128 a0 = _mm_loadu_ps(lhs), a1 = _mm_loadu_ps(lhs + 4), a2 = _mm_loadu_ps(lhs + 8), a3 = _mm_loadu_ps(lhs + 12);
+		for (int column = 0; column < 4; ++column)
+		{
+			const float* c = rhs + column * 4;
+			__m128 sum = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+			_mm_storeu_ps(result + column * 4, sum);
+		}
+#else
+		out = a * b;
+#endif
+	}
+};
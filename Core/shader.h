@@ -1,257 +1,646 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <memory>
+#include <set>
+#include <thread>
 
+inline bool HasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+        if (strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)), name) == 0)
+            return true;
+    return false;
+}
+
+// A shader variant: a source file in Assets/Shaders/ compiled with a set of defines, on top of
+// the global defines every shader gets (device limits and engine constants, see main.cpp). The
+// stage follows the extension.
+//
+// Sources go through ShaderPreprocessor, so #include works. Each variant links on its own into a
+// GL_PROGRAM_SEPARABLE program, which Programs combine in pipeline objects. A variant shared by
+// several programs is therefore compiled, linked and cached once, and its uniforms are shared
+// too. The binary lands in the ProgramCache under the expanded source.
+//
+// With UseEmbedded() sources come from the copies compiled into the executable instead of
+// Assets/Shaders/, saving the file system round trips at startup. A file the watcher reports as
+// changed is read from disk from then on, so hot reload works either way.
+//
+// With UseSpirv() a stage is built from the SPIR-V module of Tools/ShaderCompiler when there is
+// one for its current source, so the driver skips its GLSL front end; a stage without a matching
+// module, edited or a variant, logs a warning and falls back to GLSL. The global defines are saved
+// to Assets/Spirv/defines.txt, where ShaderCompiler picks them up. Stages interface by location,
+// so SPIR-V and GLSL stages mix freely in a pipeline.
+//
+// Every Shader registers itself, so all of them can be built together: Submit() only starts the
+// compile and link, PollBuild() picks up the result. A rebuild links into a second program and
+// swaps it in once it has linked successfully; a failed edit logs its errors and leaves the
+// running program in place.
 class Shader
 {
 public:
-    Shader(const char* filename) : m_Path(s_Folder / filename), m_Type(GL_TASK_SHADER_NV), m_Id(0)
+    Shader(const char* filename, ShaderDefines defines = {}) : m_Path(s_Folder / filename), m_Type(GL_TASK_SHADER_NV), m_Defines(std::move(defines))
     {
-        if (std::filesystem::is_regular_file(m_Path))
+        std::string text;
+        if (Read(m_Path, text))
         {
             if (m_Path.extension() == ".mesh")
                 m_Type = GL_MESH_SHADER_NV;
             else if (m_Path.extension() == ".frag")
                 m_Type = GL_FRAGMENT_SHADER;
-
-            m_Id = glCreateShader(m_Type);
+            else if (m_Path.extension() == ".comp")
+                m_Type = GL_COMPUTE_SHADER;
         }
         else
         {
             LOG_RUNTIME_ERROR("Shader source: {} not exists", m_Path.string());
         }
+        s_Shaders.push_back(this);
     }
 
     ~Shader()
     {
-        glDeleteShader(m_Id);
+        CancelBuild();
+        glDeleteProgram(m_Program);
+        s_Shaders.erase(std::find(s_Shaders.begin(), s_Shaders.end(), this));
     }
 
-    bool Compile()
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // The expanded source, read from disk every call so edits are picked up.
+    std::string ReadSource()
     {
-        std::ifstream file(m_Path);
-        std::string source{ std::istreambuf_iterator<char>(file), {} };
-        file.close();
-        const char* src_Str = source.c_str();
+        ShaderDefines defines = s_GlobalDefines;
+        defines.insert(defines.end(), m_Defines.begin(), m_Defines.end());
+        return ShaderPreprocessor::Expand(m_Path, defines, &m_Files, Read);
+    }
 
-        glShaderSource(m_Id, 1, &src_Str, nullptr);
+    // The SPIR-V module ShaderCompiler built from exactly `source`, empty if there is none.
+    std::string ReadSpirv(const std::string& source) const
+    {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(ProgramCache::HashBytes(source.data(), source.size())));
+        std::ifstream file(s_SpirvFolder / (m_Path.filename().string() + "_" + hash + ".spv"), std::ios::binary);
+        return std::string{ std::istreambuf_iterator<char>(file), {} };
+    }
 
-        glCompileShader(m_Id);
+    // Loads the cached binary for the current source, otherwise starts a build from it. Does
+    // nothing once the variant is built or building, so every program using it can call it.
+    void Submit()
+    {
+        if (m_Program != 0 || m_Pending != 0)
+            return;
+
+        bool spirv = false;
+        uint64_t key = GetKey(ReadInput(spirv));
+        m_Program = ProgramCache::Load(ProgramCache::GetPath(GetName(), key), key);
+        if (m_Program == 0)
+            BeginBuild();
+    }
 
-        GLint compiled; glGetShaderiv(m_Id, GL_COMPILE_STATUS, &compiled);
-        if (compiled == GL_FALSE)
+    // Compiles and links the stage from source into a second program without waiting for the
+    // result.
+    void BeginBuild()
+    {
+        CancelBuild();
+        EnableParallelCompile();
+        bool spirv = false;
+        std::string input = ReadInput(spirv);
+        m_PendingKey = GetKey(input);
+
+        m_PendingShader = glCreateShader(m_Type);
+        if (spirv)
         {
-            GLint maxLength = 0;
-            glGetShaderiv(m_Id, GL_INFO_LOG_LENGTH, &maxLength);
-            
-            // The maxLength includes the NULL character
-            std::vector<GLchar> compiler_log(maxLength);
-            glGetShaderInfoLog(m_Id, maxLength, nullptr, compiler_log.data());
-            glDeleteShader(m_Id);
-            m_Id = 0;
-
-            LOG_RUNTIME_ERROR("Shader {0} contains error(s):\n\n{1}", m_Path.filename().string().c_str(), compiler_log.data());
+            glShaderBinary(1, &m_PendingShader, GL_SHADER_BINARY_FORMAT_SPIR_V, input.data(), static_cast<GLsizei>(input.size()));
+            glSpecializeShader(m_PendingShader, "main", 0, nullptr, nullptr);
+        }
+        else
+        {
+            const char* text = input.c_str();
+            glShaderSource(m_PendingShader, 1, &text, nullptr);
+            glCompileShader(m_PendingShader);
         }
 
-        return compiled;
+        m_Pending = glCreateProgram();
+        glProgramParameteri(m_Pending, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramParameteri(m_Pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(m_Pending, m_PendingShader);
+        glLinkProgram(m_Pending);
     }
 
-    GLuint GetID() const
+    // Returns true when a build finished linking this call and is now in use.
+    bool PollBuild()
     {
-        return m_Id;
+        if (m_Pending == 0)
+            return false;
+
+        GLint complete = GL_TRUE;
+        if (EnableParallelCompile())
+            glGetProgramiv(m_Pending, GL_COMPLETION_STATUS_KHR, &complete);
+        if (!complete)
+            return false;
+
+        bool reload = m_Program != 0;
+        GLint linked; glGetProgramiv(m_Pending, GL_LINK_STATUS, &linked);
+        if (linked)
+        {
+            if (reload)
+                CopyUniforms(m_Program, m_Pending);
+            glDeleteProgram(m_Program);
+            m_Program = m_Pending;
+            m_Pending = 0;
+            ProgramCache::Store(ProgramCache::GetPath(GetName(), m_PendingKey), m_PendingKey, m_Program);
+            if (reload)
+                LOG_RUNTIME_INFO("Reloaded {}", GetName());
+        }
+        else
+        {
+            GLint compiled; glGetShaderiv(m_PendingShader, GL_COMPILE_STATUS, &compiled);
+            if (!compiled)
+                LOG_RUNTIME_ERROR("Shader {0} contains error(s):\n\n{1}", GetName(), GetInfoLog(m_PendingShader, glGetShaderiv, glGetShaderInfoLog));
+            else if (reload)
+                LOG_RUNTIME_ERROR("Reloading {} failed, keeping the previous program:\n\n{}", GetName(), GetInfoLog(m_Pending, glGetProgramiv, glGetProgramInfoLog));
+            else
+                LOG_RUNTIME_ERROR("program {} contains error(s):\n\n{}", GetName(), GetInfoLog(m_Pending, glGetProgramiv, glGetProgramInfoLog));
+        }
+        CancelBuild();
+        return linked;
+    }
+
+    bool IsBuilding() const
+    {
+        return m_Pending != 0;
+    }
+
+    // True when the last expansion read `filename` from Assets/Shaders/, itself or an include.
+    bool Uses(const std::filesystem::path& filename) const
+    {
+        for (const std::filesystem::path& file : m_Files)
+            if (file.filename() == filename)
+                return true;
+        return m_Path.filename() == filename;
+    }
+
+    // The separable program, 0 until the first build has linked. Uniforms are set on it.
+    GLuint GetProgram() const
+    {
+        return m_Program;
+    }
+
+    GLenum GetType() const
+    {
+        return m_Type;
+    }
+
+    // The glUseProgramStages() bit of the stage.
+    GLbitfield GetStageBit() const
+    {
+        switch (m_Type)
+        {
+        case GL_TASK_SHADER_NV:   return GL_TASK_SHADER_BIT_NV;
+        case GL_MESH_SHADER_NV:   return GL_MESH_SHADER_BIT_NV;
+        case GL_FRAGMENT_SHADER:  return GL_FRAGMENT_SHADER_BIT;
+        default:                  return GL_COMPUTE_SHADER_BIT;
+        }
     }
 
     const std::filesystem::path& GetPath() const
     {
         return m_Path;
-    }  
+    }
+
+    // Engine constants and device limits for every shader compiled afterwards.
+    static void SetGlobalDefines(ShaderDefines defines)
+    {
+        s_GlobalDefines = std::move(defines);
+        if (s_UseSpirv)
+            SaveSpirvDefines();
+    }
+
+    // Affects shaders created afterwards. Stays on disk when the build embedded nothing.
+    static void UseEmbedded(bool enable)
+    {
+        size_t count = 0, bytes = 0;
+        for (const EmbeddedFile* file = s_EmbeddedShaders; file->name; ++file, ++count)
+            bytes += file->size;
+        s_Embedded = enable && count > 0;
+        if (enable && count == 0)
+            LOG_RUNTIME_WARN("No shaders are embedded in this build, reading them from {}.", s_Folder.string());
+        else if (s_Embedded)
+            LOG_RUNTIME_INFO("Using {} embedded shader files, {:.1f} KiB.", count, bytes / 1024.0);
+    }
+
+    // `filename` in Assets/Shaders/ is read from disk from now on, the embedded copy is stale.
+    static void PreferDisk(const std::filesystem::path& filename)
+    {
+        s_Edited.insert(filename.generic_string());
+    }
+
+    // Affects stages built afterwards. Needs OpenGL 4.6 or GL_ARB_gl_spirv.
+    static void UseSpirv(bool enable)
+    {
+        s_UseSpirv = enable;
+        if (s_UseSpirv)
+            SaveSpirvDefines();
+    }
+
+    static const std::vector<Shader*>& GetAll()
+    {
+        return s_Shaders;
+    }
+
+    // Lets the driver use as many compiler threads as it likes. Returns false without
+    // GL_KHR_parallel_shader_compile, where every status query waits for the compile.
+    static bool EnableParallelCompile()
+    {
+        static const bool parallel = []()
+        {
+            if (!HasGLExtension("GL_KHR_parallel_shader_compile"))
+                return false;
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            return true;
+        }();
+        return parallel;
+    }
 
 private:
-    GLuint m_Id;
+    GLuint m_Program = 0;
+    GLuint m_Pending = 0;
+    GLuint m_PendingShader = 0;
+    uint64_t m_PendingKey = 0;
     GLenum m_Type;
     std::filesystem::path m_Path;
+    ShaderDefines m_Defines;
+    std::vector<std::filesystem::path> m_Files;
 
     static const std::filesystem::path s_Folder;
+    inline static const std::filesystem::path s_SpirvFolder = "Assets/Spirv/";
+    inline static const std::filesystem::path s_SpirvDefines = "Assets/Spirv/defines.txt";
+    inline static ShaderDefines s_GlobalDefines;
+    inline static std::vector<Shader*> s_Shaders;
+    inline static bool s_UseSpirv = false;
+    inline static bool s_Embedded = false;
+    inline static std::set<std::string> s_Edited;
+
+    // The ShaderPreprocessor::Reader for shaders and includes: the embedded copy when enabled
+    // and not edited since, the disk otherwise.
+    static bool Read(const std::filesystem::path& path, std::string& text)
+    {
+        if (s_Embedded)
+        {
+            std::string name = path.lexically_normal().lexically_relative(s_Folder).generic_string();
+            const EmbeddedFile* file = FindEmbeddedFile(s_EmbeddedShaders, name);
+            if (file && s_Edited.count(name) == 0)
+            {
+                text.assign(file->GetText());
+                return true;
+            }
+        }
+        return ShaderPreprocessor::ReadFile(path, text);
+    }
+
+    // File name plus the variant defines, for logs and cache entries, e.g. hair.mesh or
+    // hair.mesh_DEBUG_MESHLET_COLORS.
+    std::string GetName() const
+    {
+        std::string name = m_Path.filename().string();
+        for (const std::pair<std::string, std::string>& define : m_Defines)
+            name += "_" + define.first;
+        return name;
+    }
+
+    // What a build consumes: the SPIR-V module when enabled and available, the GLSL source
+    // otherwise.
+    std::string ReadInput(bool& spirv)
+    {
+        std::string source = ReadSource();
+        spirv = false;
+        if (!s_UseSpirv)
+            return source;
+
+        std::string module = ReadSpirv(source);
+        if (module.empty())
+        {
+            LOG_RUNTIME_WARN("No SPIR-V module of {} matches its source and defines, compiling the GLSL.", GetName());
+            return source;
+        }
+        spirv = true;
+        return module;
+    }
+
+    // Writes the global defines as NAME=VALUE lines for ShaderCompiler, which builds modules with
+    // them, in the same order. Left alone when unchanged, so the next build does not redo it all.
+    static void SaveSpirvDefines()
+    {
+        std::string text, previous;
+        for (const std::pair<std::string, std::string>& define : s_GlobalDefines)
+            text += define.first + "=" + define.second + "\n";
+        if (ShaderPreprocessor::ReadFile(s_SpirvDefines, previous) && previous == text)
+            return;
+
+        std::error_code error;
+        std::filesystem::create_directories(s_SpirvFolder, error);
+        std::ofstream file(s_SpirvDefines);
+        file << text;
+        if (!file)
+            LOG_RUNTIME_WARN("Cannot write {}, ShaderCompiler will not match this device.", s_SpirvDefines.string());
+    }
+
+    // The stage type goes in too: a separable binary is not interchangeable with a regular one.
+    uint64_t GetKey(const std::string& input) const
+    {
+        return ProgramCache::GetKey({ "separable " + std::to_string(m_Type), input });
+    }
+
+    void CancelBuild()
+    {
+        glDeleteShader(m_PendingShader);
+        m_PendingShader = 0;
+        glDeleteProgram(m_Pending);
+        m_Pending = 0;
+    }
+
+    template<typename Query, typename Log>
+    static std::string GetInfoLog(GLuint object, Query query, Log log)
+    {
+        GLint length = 0;
+        query(object, GL_INFO_LOG_LENGTH, &length);
+        std::string text(std::max(length, 1), '\0');
+        log(object, length, nullptr, text.data());
+        return text;
+    }
+
+    // Carries values set with glProgramUniform* over to a reloaded program. Samplers and blocks
+    // use layout bindings and need nothing.
+    static void CopyUniforms(GLuint from, GLuint to)
+    {
+        GLint count = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            char name[256];
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(from, i, sizeof(name), nullptr, &size, &type, name);
+            GLint source = glGetUniformLocation(from, name), target = glGetUniformLocation(to, name);
+            if (source < 0 || target < 0)
+                continue;
+
+            float values[16];
+            GLint integers[4];
+            switch (type)
+            {
+            case GL_FLOAT:      glGetUniformfv(from, source, values); glProgramUniform1fv(to, target, 1, values); break;
+            case GL_FLOAT_VEC2: glGetUniformfv(from, source, values); glProgramUniform2fv(to, target, 1, values); break;
+            case GL_FLOAT_VEC3: glGetUniformfv(from, source, values); glProgramUniform3fv(to, target, 1, values); break;
+            case GL_FLOAT_VEC4: glGetUniformfv(from, source, values); glProgramUniform4fv(to, target, 1, values); break;
+            case GL_FLOAT_MAT4: glGetUniformfv(from, source, values); glProgramUniformMatrix4fv(to, target, 1, GL_FALSE, values); break;
+            case GL_INT:
+            case GL_BOOL:       glGetUniformiv(from, source, integers); glProgramUniform1iv(to, target, 1, integers); break;
+            case GL_UNSIGNED_INT: glGetUniformuiv(from, source, reinterpret_cast<GLuint*>(integers)); glProgramUniform1uiv(to, target, 1, reinterpret_cast<GLuint*>(integers)); break;
+            default: break;
+            }
+        }
+    }
 };
 
 const std::filesystem::path Shader::s_Folder = "Assets/Shaders/";
 
 
+// A program pipeline combining the separable programs of its stages.
+//
+// Link() only submits the stages that are not built yet, WaitAll() waits for all of them, so the
+// compile and link work at startup follows the number of shader variants, not the number of
+// stage combinations. When a stage is rebuilt, every pipeline using it picks up the new program.
 class Program
 {
 public:
     Program()
     {
-        m_Id = glCreateProgram();
+        glCreateProgramPipelines(1, &m_Id);
+        s_Programs.push_back(this);
     }
 
     ~Program()
     {
-		glDeleteProgram(m_Id);
+        glDeleteProgramPipelines(1, &m_Id);
+        s_Programs.erase(std::find(s_Programs.begin(), s_Programs.end(), this));
     }
 
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    // The pipeline object.
     GLuint GetID() const
     {
         return m_Id;
     }
 
-    bool Update()
+    // The separable program of the stage of `type`, for glProgramUniform*; 0 without one.
+    GLuint GetStageID(GLenum type) const
     {
-		if (!m_Task->Compile() || !m_Mesh->Compile() || !m_Frag->Compile())
-			return false;
-
-		glAttachShader(m_Id, m_Task->GetID());
-		glAttachShader(m_Id, m_Mesh->GetID());
-		glAttachShader(m_Id, m_Frag->GetID());
-		glLinkProgram(m_Id);
-		glDetachShader(m_Id, m_Task->GetID());
-		glDetachShader(m_Id, m_Mesh->GetID());
-		glDetachShader(m_Id, m_Frag->GetID());
-
-		GLint linked; glGetProgramiv(m_Id, GL_LINK_STATUS, &linked);
-		if (linked)
-		{
-			Save();
-		}
-		else
-		{
-			GLint maxLength = 0;
-			glGetProgramiv(m_Id, GL_INFO_LOG_LENGTH, &maxLength);
-
-			// The maxLength includes the NULL character
-			std::vector<GLchar> linker_log(maxLength);
-			glGetProgramInfoLog(m_Id, maxLength, nullptr, linker_log.data());
-			glDeleteProgram(m_Id);
-			m_Id = 0;
+        for (const Shader* stage : GetStages())
+            if (stage && stage->GetType() == type)
+                return stage->GetProgram();
+        return 0;
+    }
 
-			LOG_RUNTIME_ERROR("program contains error(s):\n\n{}", linker_log.data());
-		}
-		return linked;
+    // False while a stage's first build is still pending, and after it failed.
+    bool IsLinked() const
+    {
+        bool any = false;
+        for (const Shader* stage : GetStages())
+        {
+            if (stage && stage->GetProgram() == 0)
+                return false;
+            any |= stage != nullptr;
+        }
+        return any;
     }
 
-    bool Link(std::shared_ptr<Shader> task, std::shared_ptr<Shader> mesh, std::shared_ptr<Shader> frag)
+    void Link(std::shared_ptr<Shader> task, std::shared_ptr<Shader> mesh, std::shared_ptr<Shader> frag)
     {
         m_Task = task;
-		m_Mesh = mesh;
-		m_Frag = frag;
-
-        NameThePath(
-            m_Task->GetPath().filename().stem().string().c_str(),
-            m_Mesh->GetPath().filename().stem().string().c_str(),
-            m_Frag->GetPath().filename().stem().string().c_str()
-        );
+        m_Mesh = mesh;
+        m_Frag = frag;
 
-        bool needUpdate = true;
-        if (std::filesystem::exists(m_Path))
-        {
-            std::filesystem::file_time_type programTime = std::filesystem::last_write_time(m_Path);
-            std::filesystem::file_time_type taskTime = std::filesystem::last_write_time(m_Task->GetPath());
-            std::filesystem::file_time_type meshTime = std::filesystem::last_write_time(m_Mesh->GetPath());
-            std::filesystem::file_time_type fragTime = std::filesystem::last_write_time(m_Frag->GetPath());
+        Submit();
+    }
 
-            needUpdate = (taskTime > programTime || meshTime > programTime || fragTime > programTime);
-        }
+    // Mesh + fragment only, for programs without a task stage.
+    void Link(std::shared_ptr<Shader> mesh, std::shared_ptr<Shader> frag)
+    {
+        Link(nullptr, mesh, frag);
+    }
 
-        if (needUpdate)
-        {
-            return Update();
-        }
-        else
-        {
-            Load();
+    void Link(std::shared_ptr<Shader> compute)
+    {
+        m_Compute = compute;
 
-            return true;
-        }
+        Submit();
     }
 
+    // A current program would override the pipeline, so none is left in use.
     void Use()
     {
-        glUseProgram(m_Id);
+        glUseProgram(0);
+        glBindProgramPipeline(m_Id);
     }
 
-private:
-    GLuint m_Id = 0;
-    GLenum m_Format = GL_NONE;
-    GLsizei m_Length = 0;
-    std::shared_ptr<Shader> m_Task = nullptr, m_Mesh = nullptr, m_Frag = nullptr;
-    std::filesystem::path m_Path;
+    // True when one of the stages is compiled from `filename` in Assets/Shaders/, directly or
+    // through an include.
+    bool Uses(const std::filesystem::path& filename) const
+    {
+        for (const Shader* stage : GetStages())
+            if (stage && stage->Uses(filename))
+                return true;
+        return false;
+    }
 
-    static const std::filesystem::path s_Folder;
+    // Chains the expanded source of every stage into `hash`, to key results the program computes.
+    uint64_t HashSources(uint64_t hash) const
+    {
+        for (Shader* stage : GetStages())
+            if (stage)
+                hash = ProgramCache::Hash(stage->ReadSource(), hash);
+        return hash;
+    }
 
-    void NameThePath(const char* task, const char* mesh, const char* frag)
+    // Bumped whenever a reload swaps in a rebuilt stage, so results cached from the program's
+    // output can tell they are stale.
+    uint32_t GetRevision() const
     {
-		if (!std::filesystem::exists(s_Folder))
-			std::filesystem::create_directory(s_Folder);
+        return m_Revision;
+    }
 
-        size_t len = strlen(task) + 1 + strlen(mesh) + 1 + strlen(frag) + 4 + 1;
-        char* filename = new char[len];
-        filename[0] = '\0';
-        strcat_s(filename, len, task);
-        strcat_s(filename, len, "_");
-        strcat_s(filename, len, mesh);
-        strcat_s(filename, len, "_");
-        strcat_s(filename, len, frag);
-        strcat_s(filename, len, ".bin");
-        m_Path = s_Folder / filename;
-        delete[] filename;
+    // Waits for every submitted stage. Returns whether all programs are linked.
+    static bool WaitAll()
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        const std::vector<Shader*>& shaders = Shader::GetAll();
+        size_t compiled = std::count_if(shaders.begin(), shaders.end(), [](const Shader* shader) { return shader->IsBuilding(); });
+        for (bool pending = true; pending;)
+        {
+            pending = false;
+            for (Shader* shader : shaders)
+            {
+                shader->PollBuild();
+                pending |= shader->IsBuilding();
+            }
+            if (pending)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        AttachAll();
+
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        LOG_RUNTIME_INFO("{} programs from {} stages ready in {:.1f} ms: {} compiled {}, {} from cache.", s_Programs.size(), shaders.size(), milliseconds,
+            compiled, Shader::EnableParallelCompile() ? "in parallel" : "serially", shaders.size() - compiled);
+        return std::all_of(s_Programs.begin(), s_Programs.end(), [](const Program* program) { return program->IsLinked(); });
     }
 
-    void Save()
+    // Drivers finish some compilation on the first draw with a pipeline, which would otherwise
+    // hitch the first frame. Draws one work group per graphics pipeline with the rasterizer
+    // discarded; compute programs have no draw state and are done when linked. Call once the
+    // startup buffers are bound, since the mesh stages still run.
+    static void WarmUp()
     {
-        glGetProgramiv(m_Id, GL_PROGRAM_BINARY_LENGTH, &m_Length);
-        char* binary = new char[m_Length];
+        glEnable(GL_RASTERIZER_DISCARD);
+        for (Program* program : s_Programs)
+        {
+            if (program->IsLinked() && !program->m_Compute)
+            {
+                program->Use();
+                glDrawMeshTasksNV(0, 1);
+            }
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindProgramPipeline(0);
+        glFinish();
+    }
 
-        glGetProgramBinary(m_Id, m_Length, nullptr, &m_Format, binary);
+    // Starts rebuilding every stage that uses one of `files`.
+    static void Reload(const std::vector<std::filesystem::path>& files)
+    {
+        for (const std::filesystem::path& file : files)
+            Shader::PreferDisk(file);
+        for (Shader* shader : Shader::GetAll())
+            if (std::any_of(files.begin(), files.end(), [shader](const std::filesystem::path& file) { return shader->Uses(file); }))
+                shader->BeginBuild();
+    }
 
-		std::fstream file(m_Path, std::ios::out | std::ios::trunc | std::ios::binary);
-		file.write(binary, m_Length);
-		file.close();
-        delete[] binary;
+    static void ReloadAll()
+    {
+        // An explicit reload asks for the files on disk.
+        Shader::UseEmbedded(false);
+        for (Shader* shader : Shader::GetAll())
+            shader->BeginBuild();
     }
 
-    void Load()
+    static void PollBuilds()
     {
-		std::streampos fileSize;
-		std::ifstream file(m_Path, std::ios::binary);
-		file.seekg(0, std::ios::end);
-		fileSize = file.tellg();
-		file.seekg(0, std::ios::beg);
-		char* binary = new char[fileSize];
-		file.read(binary, fileSize);
-		file.close();
+        bool rebuilt = false;
+        for (Shader* shader : Shader::GetAll())
+            rebuilt |= shader->PollBuild();
+        if (rebuilt)
+            AttachAll();
+    }
 
-        GLint* formats = new GLint;
-        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
-        m_Format = static_cast<GLenum>(*formats);
-        delete formats;
-        glProgramBinary(m_Id, m_Format, binary, static_cast<GLsizei>(fileSize));
-        delete[] binary;
+private:
+    inline static std::vector<Program*> s_Programs;
 
-		GLint linked; glGetProgramiv(m_Id, GL_LINK_STATUS, &linked);
-		if (linked == GL_FALSE)
-		{
-			GLint maxLength = 0;
-			glGetProgramiv(m_Id, GL_INFO_LOG_LENGTH, &maxLength);
+    GLuint m_Id = 0;
+    std::shared_ptr<Shader> m_Task = nullptr, m_Mesh = nullptr, m_Frag = nullptr, m_Compute = nullptr;
+    std::array<GLuint, 4> m_Attached = {};  // Per GetStages() slot.
+    uint32_t m_Revision = 0;
 
-			// The maxLength includes the NULL character
-			std::vector<GLchar> linker_log(maxLength);
-			glGetProgramInfoLog(m_Id, maxLength, nullptr, linker_log.data());
-			glDeleteProgram(m_Id);
-			m_Id = 0;
+    // Null where the pipeline has no such stage. A fixed array, since GetStageID() is called
+    // every frame.
+    std::array<Shader*, 4> GetStages() const
+    {
+        return { m_Task.get(), m_Mesh.get(), m_Frag.get(), m_Compute.get() };
+    }
+
+    void Submit()
+    {
+        for (Shader* stage : GetStages())
+            if (stage)
+                stage->Submit();
+        Attach();
+    }
 
-			LOG_RUNTIME_ERROR("program contains error(s):\n\n{}", linker_log.data());
-		}
+    // Points the pipeline at the current program of every stage that has one. Replacing a
+    // program that was already attached counts as a new revision.
+    void Attach()
+    {
+        std::array<Shader*, 4> stages = GetStages();
+        bool replaced = false;
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            GLuint program = stages[i] ? stages[i]->GetProgram() : 0;
+            if (program == 0 || program == m_Attached[i])
+                continue;
+            glUseProgramStages(m_Id, stages[i]->GetStageBit(), program);
+            replaced |= m_Attached[i] != 0;
+            m_Attached[i] = program;
+        }
+        if (replaced)
+            ++m_Revision;
     }
 
-    void Delete()
+    static void AttachAll()
     {
-		glDeleteProgram(m_Id);
-		m_Id = 0;
+        for (Program* program : s_Programs)
+            program->Attach();
     }
 };
-
-const std::filesystem::path Program::s_Folder = "Assets/ShaderCache/";
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Name and value pairs, emitted as #define lines in this order.
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+// The GLSL preprocessing the driver does not do: #include and injected defines.
+//
+// `#include "file"` is resolved against the including file's folder and pastes the file in
+// place, at most once per shader, so shared snippets need no include guards. Includes inside
+// #ifdef blocks are pasted too and left to the compiler's preprocessor. Defines go right after
+// #version. #line directives keep compiler messages pointing at the original lines; the source
+// string number is the file's index in `files`.
+//
+// Files come from a Reader, the disk by default; the renderer can hand out embedded copies.
+//
+// Shared with Tools/ShaderCompiler, so it depends on neither OpenGL nor the logger. A missing
+// include becomes an #error for the compiler to report.
+class ShaderPreprocessor
+{
+public:
+	// Fills `text` with the file, false if there is none.
+	using Reader = std::function<bool(const std::filesystem::path&, std::string&)>;
+
+	static std::string Expand(const std::filesystem::path& path, const ShaderDefines& defines, std::vector<std::filesystem::path>* files = nullptr, const Reader& read = ReadFile)
+	{
+		std::vector<std::filesystem::path> included;
+		std::string text, output;
+		read(path, text);
+		Append(path, text, defines, read, included, output);
+		if (files)
+			*files = std::move(included);
+		return output;
+	}
+
+	static std::string ToString(const ShaderDefines& defines)
+	{
+		std::string text;
+		for (const std::pair<std::string, std::string>& define : defines)
+			text += (text.empty() ? "" : " ") + define.first + "=" + define.second;
+		return text;
+	}
+
+	// Text mode, so line endings read the same on every platform.
+	static bool ReadFile(const std::filesystem::path& path, std::string& text)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+		text.assign(std::istreambuf_iterator<char>(file), {});
+		return true;
+	}
+
+private:
+	static void Append(const std::filesystem::path& path, const std::string& text, const ShaderDefines& defines, const Reader& read, std::vector<std::filesystem::path>& included, std::string& output)
+	{
+		const size_t index = included.size();
+		included.push_back(path.lexically_normal());
+		const bool root = index == 0;
+
+		std::istringstream file(text);
+		std::string line;
+		for (int number = 1; std::getline(file, line); ++number)
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+			{
+				size_t open = line.find('"', start + 8), close = open == std::string::npos ? open : line.find('"', open + 1);
+				std::filesystem::path target = path.parent_path() / line.substr(open + 1, close - open - 1);
+				std::string source;
+				if (close == std::string::npos)
+				{
+					output += "#error malformed include directive\n";
+				}
+				else if (std::find(included.begin(), included.end(), target.lexically_normal()) != included.end())
+				{
+					output += "\n";
+				}
+				else if (!read(target, source))
+				{
+					output += "#error cannot open include file " + target.filename().string() + "\n";
+				}
+				else
+				{
+					output += "#line 1 " + std::to_string(included.size()) + "\n";
+					Append(target, source, defines, read, included, output);
+					output += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+				}
+				continue;
+			}
+
+			output += line;
+			output += "\n";
+			if (root && start != std::string::npos && line.compare(start, 8, "#version") == 0 && !defines.empty())
+			{
+				for (const std::pair<std::string, std::string>& define : defines)
+					output += "#define " + define.first + " " + define.second + "\n";
+				output += "#line " + std::to_string(number + 1) + " 0\n";
+			}
+		}
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches a folder for written files on a background thread, with inotify on Linux and
+// ReadDirectoryChangesW on Windows.
+//
+// Editors often save in several writes or through a rename, so a file is only reported once it
+// has been quiet for s_Settle. TakeChanges() is cheap and meant to be polled every frame.
+class ShaderWatcher
+{
+public:
+	static constexpr std::chrono::milliseconds s_Settle{ 100 };
+
+	explicit ShaderWatcher(const std::filesystem::path& folder) : m_Folder(folder)
+	{
+		m_Thread = std::thread([this]() { Run(); });
+	}
+
+	~ShaderWatcher()
+	{
+		m_Running = false;
+		if (m_Thread.joinable())
+			m_Thread.join();
+	}
+
+	// Files changed since the last call, relative to the watched folder.
+	std::vector<std::filesystem::path> TakeChanges()
+	{
+		std::vector<std::filesystem::path> changes;
+		auto now = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (auto it = m_Pending.begin(); it != m_Pending.end();)
+		{
+			if (now - it->second >= s_Settle)
+			{
+				changes.push_back(it->first);
+				it = m_Pending.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		return changes;
+	}
+
+private:
+	std::filesystem::path m_Folder;
+	std::atomic<bool> m_Running = true;
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::map<std::string, std::chrono::steady_clock::time_point> m_Pending;
+
+	void Notify(const std::string& filename)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Pending[filename] = std::chrono::steady_clock::now();
+	}
+
+	// Wakes up at least every 100 ms to notice shutdown.
+	void Run()
+	{
+#if defined(_WIN32)
+		HANDLE directory = CreateFileW(m_Folder.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (directory == INVALID_HANDLE_VALUE)
+		{
+			LOG_RUNTIME_WARN("Cannot watch {} for changes.", m_Folder.string());
+			return;
+		}
+
+		alignas(DWORD) char buffer[16 * 1024];
+		OVERLAPPED overlapped = {};
+		overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		bool reading = false;
+		while (m_Running)
+		{
+			if (!reading)
+			{
+				ResetEvent(overlapped.hEvent);
+				reading = ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr);
+				if (!reading)
+					break;
+			}
+			if (WaitForSingleObject(overlapped.hEvent, 100) != WAIT_OBJECT_0)
+				continue;
+
+			reading = false;
+			DWORD bytes = 0;
+			if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE) || bytes == 0)
+				continue;
+			for (char* entry = buffer;;)
+			{
+				const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+				if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+					Notify(std::filesystem::path(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR))).string());
+				if (info->NextEntryOffset == 0)
+					break;
+				entry += info->NextEntryOffset;
+			}
+		}
+
+		// The cancelled read still owns `buffer` and `overlapped` until it completes.
+		if (reading && CancelIo(directory))
+		{
+			DWORD bytes = 0;
+			GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+		}
+		CloseHandle(overlapped.hEvent);
+		CloseHandle(directory);
+#elif defined(__linux__)
+		int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0 || inotify_add_watch(fd, m_Folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			LOG_RUNTIME_WARN("Cannot watch {} for changes.", m_Folder.string());
+			if (fd >= 0)
+				close(fd);
+			return;
+		}
+
+		alignas(inotify_event) char buffer[16 * 1024];
+		while (m_Running)
+		{
+			pollfd request = { fd, POLLIN, 0 };
+			if (poll(&request, 1, 100) <= 0)
+				continue;
+
+			ssize_t length;
+			while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char* entry = buffer; entry < buffer + length;)
+				{
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(entry);
+					if (event->len > 0)
+						Notify(event->name);
+					entry += sizeof(inotify_event) + event->len;
+				}
+			}
+		}
+		close(fd);
+#else
+		LOG_RUNTIME_WARN("Shader hot reload is not supported on this platform.");
+#endif
+	}
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Deep opacity maps (Yuksel & Keyser 2008) for hair self-shadowing.
+//
+// Two passes from the light: a depth pass that finds the first strand (z0) per texel,
+// then an additive pass that accumulates strand opacity into up to four layers behind z0.
+// The maps are only regenerated when the light, the groom transform or the simulation
+// state changes; otherwise last frame's maps are reused.
+class DeepOpacityMap
+{
+public:
+	// Same layout as the mesh stages' uniforms_t block at binding 0.
+	struct LightMatrices
+	{
+		glm::mat4 VP;
+		glm::mat4 M;
+		glm::vec3 LightPos;
+		float padding = 0.0f;
+	};
+
+	struct ShadowUBO
+	{
+		glm::mat4 LightVP;
+		glm::vec4 LayerDepths;     // Cumulative layer end depths behind z0, in [0, 1] light depth.
+		float StrandOpacity = 0.0f;
+		float ShadowDensity = 0.1f;
+		float padding0 = 0.0f;
+		float padding1 = 0.0f;
+	};
+
+	DeepOpacityMap(int resolution = 1024) : m_Resolution(resolution)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_DepthTexture);
+		glTextureStorage2D(m_DepthTexture, 1, GL_DEPTH_COMPONENT32F, m_Resolution, m_Resolution);
+		glTextureParameteri(m_DepthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(m_DepthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTextureParameteri(m_DepthTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTextureParameteri(m_DepthTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		GLfloat farDepth[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTextureParameterfv(m_DepthTexture, GL_TEXTURE_BORDER_COLOR, farDepth);
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_OpacityTexture);
+		glTextureStorage2D(m_OpacityTexture, 1, GL_RGBA16F, m_Resolution, m_Resolution);
+		glTextureParameteri(m_OpacityTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_OpacityTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(m_OpacityTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTextureParameteri(m_OpacityTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		GLfloat noOpacity[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glTextureParameterfv(m_OpacityTexture, GL_TEXTURE_BORDER_COLOR, noOpacity);
+
+		glCreateBuffers(2, m_UBOs);
+		glNamedBufferData(m_UBOs[0], sizeof(LightMatrices), nullptr, GL_DYNAMIC_DRAW);
+		glNamedBufferData(m_UBOs[1], sizeof(ShadowUBO), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	~DeepOpacityMap()
+	{
+		glDeleteBuffers(2, m_UBOs);
+		glDeleteTextures(1, &m_OpacityTexture);
+		glDeleteTextures(1, &m_DepthTexture);
+	}
+
+	// Returns true if the cached maps no longer match the light, groom transform or simulation state.
+	bool IsDirty(const glm::vec3& lightDirection, const glm::mat4& model, uint32_t simulationVersion) const
+	{
+		return !m_Valid || lightDirection != m_LightDirection || model != m_Model || simulationVersion != m_SimulationVersion;
+	}
+
+	// Fits an orthographic light frustum around the groom's bounding sphere (xyz: center, w: radius, model space)
+	// and uploads the light matrices. Call before the two passes of a regeneration.
+	void Prepare(const glm::vec3& lightDirection, const glm::mat4& model, uint32_t simulationVersion, const glm::vec4& boundingSphere, float strandOpacity)
+	{
+		m_LightDirection = lightDirection;
+		m_Model = model;
+		m_SimulationVersion = simulationVersion;
+
+		float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(boundingSphere), 1.0f));
+		float radius = boundingSphere.w * scale;
+
+		glm::vec3 L = glm::normalize(lightDirection);
+		glm::vec3 up = glm::abs(L.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 view = glm::lookAt(center + L * radius * 2.0f, center, up);
+		glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, radius * 3.0f);
+
+		LightMatrices matrices = { projection * view, model, center + L * radius * 2.0f };
+		glNamedBufferSubData(m_UBOs[0], 0, sizeof(LightMatrices), &matrices);
+
+		// Layer ends are in [0, 1] light depth, which spans the groom's diameter. The first layers are
+		// thin because most of the visible self-shadowing happens right below the outer strands.
+		float layer = 0.02f;
+		m_Shadow.LightVP = matrices.VP;
+		m_Shadow.LayerDepths = glm::vec4(layer, layer * 3.0f, layer * 7.0f, layer * 15.0f);
+		m_Shadow.StrandOpacity = strandOpacity;
+		glNamedBufferSubData(m_UBOs[1], 0, sizeof(ShadowUBO), &m_Shadow);
+	}
+
+	// Depth-only pass into GetDepthTexture(), cleared to 1: the mesh stage must read its matrices from binding 0.
+	void BeginDepthPass()
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_UBOs[0]);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
+	}
+
+	// Opacity accumulation pass into GetOpacityTexture(), cleared to 0: every fragment is
+	// additively blended into the layers behind z0.
+	void BeginOpacityPass()
+	{
+		glDisable(GL_DEPTH_TEST);
+		glBlendFunc(GL_ONE, GL_ONE);
+		Bind();
+	}
+
+	// Restores the state the frame expects and the camera matrices at binding 0.
+	void End(GLuint cameraUBO)
+	{
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glEnable(GL_DEPTH_TEST);
+		glBindBufferBase(GL_UNIFORM_BUFFER, 0, cameraUBO);
+
+		m_Valid = true;
+	}
+
+	// Binds the maps and shadow parameters for shading.
+	void Bind() const
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, 2, m_UBOs[1]);
+		glBindTextureUnit(1, m_DepthTexture);
+		glBindTextureUnit(2, m_OpacityTexture);
+	}
+
+	// Shading-only parameter, does not require a regeneration.
+	void SetDensity(float density)
+	{
+		m_Shadow.ShadowDensity = density;
+		glNamedBufferSubData(m_UBOs[1], offsetof(ShadowUBO, ShadowDensity), sizeof(float), &m_Shadow.ShadowDensity);
+	}
+
+	GLuint GetDepthTexture() const
+	{
+		return m_DepthTexture;
+	}
+
+	GLuint GetOpacityTexture() const
+	{
+		return m_OpacityTexture;
+	}
+
+	int GetResolution() const
+	{
+		return m_Resolution;
+	}
+
+	void Invalidate()
+	{
+		m_Valid = false;
+	}
+
+private:
+	int m_Resolution;
+	GLuint m_DepthTexture = 0, m_OpacityTexture = 0;
+	GLuint m_UBOs[2] = { 0, 0 };
+
+	bool m_Valid = false;
+
+	glm::vec3 m_LightDirection = glm::vec3(0.0f);
+	glm::mat4 m_Model = glm::mat4(1.0f);
+	uint32_t m_SimulationVersion = 0;
+	ShadowUBO m_Shadow;
+};
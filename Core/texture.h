@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_SSE 1
+#endif
+
+// Widens tightly packed RGB8 to RGBA8 with opaque alpha. GPUs have no native 24-bit formats, so
+// uploading GL_RGB makes the driver do this on the calling thread instead.
+inline void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixels)
+{
+	size_t i = 0;
+#if defined(TEXTURE_SSE)
+	// Four pixels per step; each 16 byte load covers 12 used bytes, so stop 6 pixels early.
+	// SSE2 has no byte shuffle: pixel k sits at byte 3k and belongs at byte 4k, so it is
+	// shifted up by k bytes and masked into its 32-bit lane.
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	const __m128i lane0 = _mm_setr_epi32(0x00FFFFFF, 0, 0, 0);
+	const __m128i lane1 = _mm_setr_epi32(0, 0x00FFFFFF, 0, 0);
+	const __m128i lane2 = _mm_setr_epi32(0, 0, 0x00FFFFFF, 0);
+	const __m128i lane3 = _mm_setr_epi32(0, 0, 0, 0x00FFFFFF);
+	for (; i + 6 <= pixels; i += 4)
+	{
+		__m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+		__m128i result = _mm_or_si128(alpha, _mm_and_si128(source, lane0));
+		result = _mm_or_si128(result, _mm_and_si128(_mm_slli_si128(source, 1), lane1));
+		result = _mm_or_si128(result, _mm_and_si128(_mm_slli_si128(source, 2), lane2));
+		result = _mm_or_si128(result, _mm_and_si128(_mm_slli_si128(source, 3), lane3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), result);
+	}
+#endif
+	for (; i < pixels; ++i)
+	{
+		rgba[i * 4 + 0] = rgb[i * 3 + 0];
+		rgba[i * 4 + 1] = rgb[i * 3 + 1];
+		rgba[i * 4 + 2] = rgb[i * 3 + 2];
+		rgba[i * 4 + 3] = 0xFF;
+	}
+}
+
+inline void SetCubeMapSampling(GLuint textureID)
+{
+	glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+// The face images of a cube map folder, in GL face order.
+inline std::vector<std::filesystem::path> GetCubeMapFaces(const std::filesystem::path& path)
+{
+	static const char* const filenames[] = {
+		"px.png",
+		"nx.png",
+		"py.png",
+		"ny.png",
+		"pz.png",
+		"nz.png"
+	};
+
+	std::vector<std::filesystem::path> faces;
+	for (const char* filename : filenames)
+		faces.push_back(path / filename);
+	return faces;
+}
+
+// The edge length shared by the square faces, from the first readable header; 0 if none.
+inline int GetCubeMapSize(const std::string files[6])
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		int width, height, channels;
+		if (stbi_info(files[i].c_str(), &width, &height, &channels) && width == height)
+			return width;
+	}
+	return 0;
+}
+
+// Decodes a face of `size` x `size` to RGBA8 at `destination`. No GL calls, safe in a job.
+inline bool DecodeCubeMapFace(const std::string& file, int size, unsigned char* destination)
+{
+	int width, height, channels;
+	if (!stbi_info(file.c_str(), &width, &height, &channels) || width != size || height != size)
+		return false;
+
+	unsigned char* data = stbi_load(file.c_str(), &width, &height, &channels, channels == 3 ? 3 : 4);
+	if (!data)
+		return false;
+	if (channels == 3)
+		ExpandRGBToRGBA(data, destination, static_cast<size_t>(size) * size);
+	else
+		memcpy(destination, data, static_cast<size_t>(size) * size * 4);
+	stbi_image_free(data);
+	return true;
+}
+
+// Loads px/nx/py/ny/pz/nz.png from a folder into a mipmapped cube map.
+//
+// A fresh BC7 entry in the texture cache is used directly. Otherwise faces are sized from their
+// headers, then decoded as jobs straight into a mapped pixel unpack buffer, so loading takes
+// about as long as the slowest face. The texture uploads are sourced from that buffer and return
+// without waiting for the copy; the result is then cooked into the cache for the next run.
+inline GLuint CreateCubeMap(const std::filesystem::path& path)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::filesystem::path> sources = GetCubeMapFaces(path);
+	std::string files[6];
+	for (int i = 0; i < 6; ++i)
+		files[i] = sources[i].string();
+
+	std::filesystem::path cached = TextureCache::GetPath(path);
+	if (TextureCache::IsFresh(cached, sources))
+	{
+		GLuint textureID = TextureCache::Load(cached);
+		if (textureID)
+		{
+			SetCubeMapSampling(textureID);
+			auto end = std::chrono::high_resolution_clock::now();
+			LOG_RUNTIME_INFO("Cubemap {} loaded from {} in {:.1f} ms", path.string(), cached.string(), std::chrono::duration<double, std::milli>(end - start).count());
+			return textureID;
+		}
+	}
+
+	GLuint textureID;
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+	SetCubeMapSampling(textureID);
+
+	int size = GetCubeMapSize(files);
+	if (size == 0)
+	{
+		LOG_RUNTIME_WARN("Cubemap tex failed to load at path: {}", path.string());
+		return textureID;
+	}
+
+	GLsizei levels = static_cast<GLsizei>(std::log2(size)) + 1;
+	glTextureStorage2D(textureID, levels, GL_RGBA8, size, size);
+
+	const GLsizeiptr faceBytes = static_cast<GLsizeiptr>(size) * size * 4;
+	GLuint buffer;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, faceBytes * 6, nullptr, GL_MAP_WRITE_BIT);
+	unsigned char* mapped = static_cast<unsigned char*>(glMapNamedBufferRange(buffer, 0, faceBytes * 6, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+	// Decoding only touches the mapped memory, no GL calls off the render thread.
+	bool loaded[6] = {};
+	if (mapped)
+	{
+		JobSystem& jobs = JobSystem::Get();
+		jobs.Wait(jobs.ParallelFor(6, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				loaded[i] = DecodeCubeMapFace(files[i], size, mapped + i * faceBytes);
+		}));
+	}
+	glUnmapNamedBuffer(buffer);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	for (int i = 0; i < 6; ++i)
+	{
+		if (loaded[i])
+			glTextureSubImage3D(textureID, 0, 0, 0, i, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(i * faceBytes));
+		else
+			LOG_RUNTIME_WARN("Cubemap face {} failed to load or is not {}x{}.", files[i], size, size);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	// The buffer lives on until the pending copies have consumed it.
+	glDeleteBuffers(1, &buffer);
+
+	glGenerateTextureMipmap(textureID);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	LOG_RUNTIME_INFO("Cubemap {} ({}x{}) decoded in {:.1f} ms", path.string(), size, size, std::chrono::duration<double, std::milli>(end - start).count());
+
+	// First run: encode to BC7 and switch to the compressed copy.
+	if (std::all_of(std::begin(loaded), std::end(loaded), [](bool face) { return face; }) && TextureCache::Cook(textureID, GL_COMPRESSED_RGBA_BPTC_UNORM, cached))
+	{
+		GLuint compressed = TextureCache::Load(cached);
+		if (compressed)
+		{
+			glDeleteTextures(1, &textureID);
+			textureID = compressed;
+			SetCubeMapSampling(textureID);
+		}
+	}
+	return textureID;
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Block-compressed textures cached on disk as KTX2.
+//
+// Cook() takes an uncompressed texture with its full mip chain, lets the driver encode every
+// level to BC7 (LDR) or BC6H (HDR) and writes the blocks to Assets/TextureCache/. Later runs
+// Load() the file, which is a read plus one glCompressedTextureSubImage3D per level.
+//
+// An entry is named either after its source path, and then stale once a source file is newer
+// than it (IsFresh), or after a hash of its source content (HashFile), and then never
+// stale: changed content looks up a different entry.
+class TextureCache
+{
+public:
+	// Cache file for a source file or folder, tagged when one source yields several textures.
+	static std::filesystem::path GetPath(const std::filesystem::path& source, const char* tag = "")
+	{
+		std::string name = source.filename().empty() ? source.parent_path().filename().string() : source.stem().string();
+		if (tag[0] != '\0')
+			name += std::string("_") + tag;
+
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(std::hash<std::string>()(source.generic_string() + tag)));
+		return s_Folder / (name + "_" + hash + ".ktx2");
+	}
+
+	// Cache file for content identified by a hash rather than by a path.
+	static std::filesystem::path GetPath(const char* name, uint64_t hash, const char* extension = ".ktx2")
+	{
+		char filename[128];
+		snprintf(filename, sizeof(filename), "%s_%016llx%s", name, static_cast<unsigned long long>(hash), extension);
+		return s_Folder / filename;
+	}
+
+	// ProgramCache::HashBytes over a file's bytes, chained through `hash` to key on several files.
+	static uint64_t HashFile(const std::filesystem::path& path, uint64_t hash = 14695981039346656037ull)
+	{
+		std::ifstream file(path, std::ios::binary);
+		char buffer[64 * 1024];
+		while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+			hash = ProgramCache::HashBytes(buffer, static_cast<size_t>(file.gcount()), hash);
+		return hash;
+	}
+
+	static bool IsFresh(const std::filesystem::path& cached, const std::vector<std::filesystem::path>& sources)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(cached, error))
+			return false;
+
+		std::filesystem::file_time_type cachedTime = std::filesystem::last_write_time(cached, error);
+		for (const std::filesystem::path& source : sources)
+			if (std::filesystem::exists(source, error) && std::filesystem::last_write_time(source, error) > cachedTime)
+				return false;
+		return true;
+	}
+
+	// Creates a 2D or cube map texture from a cached KTX2 file, 0 if it cannot be used.
+	static GLuint Load(const std::filesystem::path& cached)
+	{
+		std::ifstream file(cached, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+			return 0;
+		std::vector<char> data(static_cast<size_t>(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		file.read(data.data(), data.size());
+		file.close();
+
+		Header header;
+		if (data.size() < sizeof(Header) || memcmp(data.data(), s_Identifier, sizeof(s_Identifier)) != 0)
+		{
+			LOG_RUNTIME_WARN("{} is not a KTX2 file.", cached.string());
+			return 0;
+		}
+		memcpy(&header, data.data(), sizeof(Header));
+
+		GLenum format = ToGLFormat(header.vkFormat);
+		if (format == GL_NONE || header.supercompressionScheme != 0 || (header.faceCount != 1 && header.faceCount != 6) || header.levelCount == 0 ||
+			data.size() < sizeof(Header) + sizeof(LevelIndex) * header.levelCount)
+		{
+			LOG_RUNTIME_WARN("{} has an unsupported KTX2 layout.", cached.string());
+			return 0;
+		}
+
+		std::vector<LevelIndex> levels(header.levelCount);
+		memcpy(levels.data(), data.data() + sizeof(Header), sizeof(LevelIndex) * header.levelCount);
+		for (const LevelIndex& level : levels)
+		{
+			if (level.byteOffset + level.byteLength > data.size())
+			{
+				LOG_RUNTIME_WARN("{} is truncated.", cached.string());
+				return 0;
+			}
+		}
+
+		GLuint texture;
+		glCreateTextures(header.faceCount == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, header.levelCount, format, header.pixelWidth, header.pixelHeight);
+		for (uint32_t level = 0; level < header.levelCount; ++level)
+		{
+			GLsizei width = std::max(1u, header.pixelWidth >> level);
+			GLsizei height = std::max(1u, header.pixelHeight >> level);
+			glCompressedTextureSubImage3D(texture, level, 0, 0, 0, width, height, header.faceCount, format,
+				static_cast<GLsizei>(levels[level].byteLength), data.data() + levels[level].byteOffset);
+		}
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return texture;
+	}
+
+	// Encodes every level of an uncompressed 2D or cube map texture and writes the cache file.
+	// `format` is GL_COMPRESSED_RGBA_BPTC_UNORM, its sRGB variant or GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT.
+	static bool Cook(GLuint source, GLenum format, const std::filesystem::path& cached)
+	{
+		uint32_t vkFormat = ToVkFormat(format);
+		if (vkFormat == 0)
+			return false;
+
+		GLint target = 0, levels = 0, width = 0, height = 0;
+		glGetTextureParameteriv(source, GL_TEXTURE_TARGET, &target);
+		glGetTextureParameteriv(source, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+		glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_HEIGHT, &height);
+		if ((target != GL_TEXTURE_2D && target != GL_TEXTURE_CUBE_MAP) || levels == 0)
+			return false;
+
+		const uint32_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+		const bool hdr = format == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		const GLenum type = hdr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+		const size_t texelSize = hdr ? 16 : 4;
+
+		// A mutable texture specified from uncompressed data is compressed by the driver.
+		GLuint encoder;
+		glCreateTextures(target, 1, &encoder);
+		glBindTexture(target, encoder);
+		glTextureParameteri(encoder, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+		std::vector<char> texels;
+		for (GLint level = 0; level < levels; ++level)
+		{
+			GLsizei levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+			size_t faceSize = texelSize * levelWidth * levelHeight;
+			texels.resize(faceSize * faces);
+			glGetTextureImage(source, level, GL_RGBA, type, static_cast<GLsizei>(texels.size()), texels.data());
+			for (uint32_t face = 0; face < faces; ++face)
+			{
+				GLenum faceTarget = faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+				glTexImage2D(faceTarget, level, format, levelWidth, levelHeight, 0, GL_RGBA, type, texels.data() + face * faceSize);
+			}
+		}
+		glBindTexture(target, 0);
+
+		GLint compressed = GL_FALSE;
+		glGetTextureLevelParameteriv(encoder, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		if (!compressed)
+		{
+			LOG_RUNTIME_WARN("The driver did not compress {}, not caching it.", cached.string());
+			glDeleteTextures(1, &encoder);
+			return false;
+		}
+
+		// Blocks of every level; the file stores the smallest level first.
+		std::vector<std::vector<char>> blocks(levels);
+		for (GLint level = 0; level < levels; ++level)
+		{
+			GLsizei levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+			blocks[level].resize(static_cast<size_t>((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * 16 * faces);
+			glGetCompressedTextureImage(encoder, level, static_cast<GLsizei>(blocks[level].size()), blocks[level].data());
+		}
+		glDeleteTextures(1, &encoder);
+
+		Header header = {};
+		memcpy(header.identifier, s_Identifier, sizeof(s_Identifier));
+		header.vkFormat = vkFormat;
+		header.typeSize = 1;
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.faceCount = faces;
+		header.levelCount = levels;
+
+		std::vector<uint32_t> dfd = DataFormatDescriptor(format);
+		header.dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + sizeof(LevelIndex) * levels);
+		header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+		std::vector<LevelIndex> index(levels);
+		uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+		for (GLint level = levels - 1; level >= 0; --level)
+		{
+			offset = (offset + 15) & ~uint64_t(15);
+			index[level] = { offset, blocks[level].size(), blocks[level].size() };
+			offset += blocks[level].size();
+		}
+
+		CreateFolder();
+		std::ofstream file(cached, std::ios::out | std::ios::trunc | std::ios::binary);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(index.data()), sizeof(LevelIndex) * index.size());
+		file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+		for (GLint level = levels - 1; level >= 0; --level)
+		{
+			while (static_cast<uint64_t>(file.tellp()) < index[level].byteOffset)
+				file.put('\0');
+			file.write(blocks[level].data(), blocks[level].size());
+		}
+		file.close();
+
+		LOG_RUNTIME_INFO("Texture cached to {} ({}x{}, {} levels, {} faces)", cached.string(), width, height, levels, faces);
+		return true;
+	}
+
+	static void CreateFolder()
+	{
+		if (!std::filesystem::exists(s_Folder))
+			std::filesystem::create_directory(s_Folder);
+	}
+
+private:
+	inline static const std::filesystem::path s_Folder = "Assets/TextureCache/";
+	static constexpr unsigned char s_Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// VkFormat values of the block formats used here.
+	static constexpr uint32_t s_VkBC6HUfloat = 143;
+	static constexpr uint32_t s_VkBC7Unorm = 145;
+	static constexpr uint32_t s_VkBC7Srgb = 146;
+
+	struct Header
+	{
+		unsigned char identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Header) == 80, "KTX2 header is 80 bytes");
+
+	struct LevelIndex
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	static uint32_t ToVkFormat(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT: return s_VkBC6HUfloat;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:         return s_VkBC7Unorm;
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:   return s_VkBC7Srgb;
+		default:                                    return 0;
+		}
+	}
+
+	static GLenum ToGLFormat(uint32_t vkFormat)
+	{
+		switch (vkFormat)
+		{
+		case s_VkBC6HUfloat: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		case s_VkBC7Unorm:   return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case s_VkBC7Srgb:    return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		default:             return GL_NONE;
+		}
+	}
+
+	// Khronos basic data format descriptor for a 4x4 block format with one 128-bit sample.
+	static std::vector<uint32_t> DataFormatDescriptor(GLenum format)
+	{
+		const bool hdr = format == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		const uint32_t colorModel = hdr ? 133 : 134;  // KHR_DF_MODEL_BC6H, KHR_DF_MODEL_BC7
+		const uint32_t transfer = format == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM ? 2 : 1;  // sRGB, linear
+		const uint32_t blockSize = 24 + 16;
+
+		return {
+			4 + blockSize,                                       // total size
+			0,                                                   // vendor 0, type 0
+			2u | (blockSize << 16),                              // version 2, block size
+			colorModel | (1u << 8) | (transfer << 16),           // model, BT.709 primaries, transfer, flags
+			3u | (3u << 8),                                      // 4x4x1x1 texel block
+			16,                                                  // bytes in plane 0
+			0,
+			0u | (127u << 16) | ((hdr ? 0x80u : 0u) << 24),      // bit offset 0, 128 bits, channel (float for BC6H)
+			0,                                                   // sample position
+			0,                                                   // lower
+			hdr ? 0x3F800000u : 0xFFFFFFFFu,                     // upper
+		};
+	}
+};
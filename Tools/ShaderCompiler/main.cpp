@@ -0,0 +1,240 @@
+// Offline shader build: compiles every shader in Assets/Shaders/ to SPIR-V for ARB_gl_spirv.
+//
+// Each shader is expanded by the renderer's ShaderPreprocessor, goes through glslangValidator
+// (from the Vulkan SDK, or given with --glslang) and lands in Assets/Spirv/ as <file>_<hash>.spv,
+// where <hash> is the FNV-1a hash of the expanded source. The renderer looks modules up by that
+// hash, so a stale module is never loaded: an edited shader falls back to GLSL, with a warning,
+// until the next build. Older modules of the same shader are removed.
+//
+// The renderer defines device limits and engine constants in every shader. Run with --spirv, it
+// saves them to defines.txt in the output folder, and the build uses that file; -D adds to it or
+// overrides single defines, e.g. to build for another GPU. Without either there is nothing to
+// match, and the tool builds nothing. Only the default variant of each shader is built, variants
+// with extra defines compile from GLSL.
+//
+// Run from the solution folder, like Core, whose pre-build step runs it after --embed so shader
+// errors fail the build. The exit code is the number of shaders that failed, which is all a CI
+// job needs to validate the shaders without a GPU.
+//
+// With --embed the tool instead writes every file of the shader folder, includes too, into a
+// C++ header of constexpr EmbeddedFile data (Core/embeddedfiles.h).
+// Core runs this as its pre-build step. The header is only rewritten when its content changes.
+//
+//   ShaderCompiler [--shaders DIR] [--output DIR] [--glslang PATH] [-D NAME=VALUE]...
+//   ShaderCompiler --embed HEADER [--shaders DIR]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../Core/shaderpreprocessor.h"
+
+namespace
+{
+	// FNV-1a over the whole source, as Shader::ReadSpirv() looks modules up.
+	uint64_t Hash(const std::string& text)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : text)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	std::filesystem::path FindGlslang()
+	{
+		const char* name = "glslangValidator";
+		if (const char* sdk = std::getenv("VULKAN_SDK"))
+		{
+#if defined(_WIN32)
+			std::filesystem::path path = std::filesystem::path(sdk) / "Bin" / "glslangValidator.exe";
+#else
+			std::filesystem::path path = std::filesystem::path(sdk) / "bin" / name;
+#endif
+			if (std::filesystem::exists(path))
+				return path;
+		}
+		return name;
+	}
+
+	bool IsShader(const std::filesystem::path& path)
+	{
+		for (const char* extension : { ".task", ".mesh", ".frag", ".comp" })
+			if (path.extension() == extension)
+				return true;
+		return false;
+	}
+
+	// Writes every shader and include of `shaders` as constexpr data. Returns false on failure.
+	bool Embed(const std::filesystem::path& shaders, const std::filesystem::path& header)
+	{
+		std::vector<std::filesystem::path> files;
+		std::error_code error;
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(shaders, error))
+			if (entry.is_regular_file() && (IsShader(entry.path()) || entry.path().extension() == ".glsl"))
+				files.push_back(entry.path());
+		if (error)
+		{
+			std::cerr << shaders.string() << ": " << error.message() << std::endl;
+			return false;
+		}
+		std::sort(files.begin(), files.end());
+
+		std::string table, code = "// Generated by Tools/ShaderCompiler --embed from " + shaders.generic_string() + ", do not edit.\n\n";
+		size_t bytes = 0;
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			std::string text;
+			ShaderPreprocessor::ReadFile(files[i], text);
+			bytes += text.size();
+
+			// Character literals instead of one string, which MSVC caps at 64 KiB.
+			const std::string name = "s_EmbeddedShader" + std::to_string(i);
+			code += "inline constexpr char " + name + "[] = {";
+			for (size_t c = 0; c < text.size(); ++c)
+			{
+				char byte[8];
+				snprintf(byte, sizeof(byte), "'\\x%02x',", static_cast<unsigned char>(text[c]));
+				code += (c % 16 == 0 ? "\n\t" : " ") + std::string(byte);
+			}
+			code += "\n\t0\n};\n";
+			table += "\t{ \"" + files[i].lexically_relative(shaders).generic_string() + "\", " + name + ", " + std::to_string(text.size()) + " },\n";
+		}
+		code += "\ninline constexpr EmbeddedFile s_EmbeddedShaders[] = {\n" + table + "\t{ nullptr, nullptr, 0 }\n};\n";
+
+		std::string previous;
+		if (ShaderPreprocessor::ReadFile(header, previous) && previous == code)
+		{
+			std::cout << files.size() << " shader files up to date in " << header.string() << "." << std::endl;
+			return true;
+		}
+
+		std::filesystem::create_directories(header.parent_path(), error);
+		std::ofstream file(header);
+		file << code;
+		if (!file)
+		{
+			std::cerr << header.string() << ": cannot write." << std::endl;
+			return false;
+		}
+		std::cout << files.size() << " shader files, " << bytes << " bytes embedded in " << header.string() << "." << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::filesystem::path shaders = "Assets/Shaders/";
+	std::filesystem::path output = "Assets/Spirv/";
+	std::filesystem::path glslang = FindGlslang();
+	std::filesystem::path embed;
+	ShaderDefines defines;
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--shaders") == 0 && hasValue)
+			shaders = argv[++i];
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--glslang") == 0 && hasValue)
+			glslang = argv[++i];
+		else if (strcmp(argv[i], "--embed") == 0 && hasValue)
+			embed = argv[++i];
+		else if (strcmp(argv[i], "-D") == 0 && hasValue && strchr(argv[i + 1], '=') != nullptr)
+		{
+			std::string define = argv[++i];
+			size_t equals = define.find('=');
+			defines.emplace_back(define.substr(0, equals), define.substr(equals + 1));
+		}
+		else
+			std::cerr << "Unknown command line argument \"" << argv[i] << "\"." << std::endl;
+	}
+
+	if (!embed.empty())
+		return Embed(shaders, embed) ? 0 : 1;
+
+	// The saved defines first, in the renderer's order, so the expanded source matches its own.
+	ShaderDefines saved;
+	std::ifstream savedFile(output / "defines.txt");
+	for (std::string line; std::getline(savedFile, line);)
+	{
+		size_t equals = line.find('=');
+		if (equals == std::string::npos)
+			continue;
+		std::string name = line.substr(0, equals);
+		auto given = std::find_if(defines.begin(), defines.end(), [&name](const std::pair<std::string, std::string>& define) { return define.first == name; });
+		if (given == defines.end())
+			saved.emplace_back(name, line.substr(equals + 1));
+		else
+		{
+			saved.push_back(*given);
+			defines.erase(given);
+		}
+	}
+	defines.insert(defines.begin(), saved.begin(), saved.end());
+	if (defines.empty())
+	{
+		std::cout << "No shader defines in " << (output / "defines.txt").string() << " or on the command line, run Core with --spirv once to save them. Nothing to build." << std::endl;
+		return 0;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(output, error);
+
+	int failed = 0, compiled = 0, upToDate = 0;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(shaders, error))
+	{
+		const std::filesystem::path& source = entry.path();
+		if (!entry.is_regular_file() || !IsShader(source))
+			continue;
+
+		std::string expanded = ShaderPreprocessor::Expand(source, defines);
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(Hash(expanded)));
+		const std::string prefix = source.filename().string() + "_";
+		const std::filesystem::path module = output / (prefix + hash + ".spv");
+
+		for (const std::filesystem::directory_entry& old : std::filesystem::directory_iterator(output, error))
+			if (old.path() != module && old.path().extension() == ".spv" && old.path().filename().string().rfind(prefix, 0) == 0)
+				std::filesystem::remove(old.path(), error);
+
+		if (std::filesystem::exists(module))
+		{
+			++upToDate;
+			continue;
+		}
+
+		// glslang sees the expanded source; -G targets OpenGL SPIR-V, the stage follows the extension.
+		const std::filesystem::path input = output / ("expanded_" + source.filename().string());
+		std::ofstream(input) << expanded;
+		std::string command = "\"" + glslang.string() + "\" -G --quiet -o \"" + module.string() + "\" \"" + input.string() + "\"";
+#if defined(_WIN32)
+		// cmd strips the outer quotes of a command line that starts with one.
+		command = "\"" + command + "\"";
+#endif
+		int result = std::system(command.c_str());
+		std::filesystem::remove(input, error);
+		if (result == 0)
+		{
+			++compiled;
+		}
+		else
+		{
+			std::filesystem::remove(module, error);
+			std::cerr << source.string() << ": SPIR-V compilation failed." << std::endl;
+			++failed;
+		}
+	}
+
+	std::cout << compiled << " compiled, " << upToDate << " up to date, " << failed << " failed." << std::endl;
+	return failed;
+}